@@ -1,5 +1,18 @@
 #include "includes.h"
 
+/* Opening files of other processes is not supported */
+int
+lc_openProcessFile(pid_t pid, int fd, int flags) {
+    errno = ENOTSUP;
+    return -1;
+}
+
+/* Splicing is not supported */
+int
+lc_deviceOpenSplice(char *device) {
+    return -1;
+}
+
 /* Open a device */
 int
 lc_deviceOpen(char *device) {
@@ -30,3 +43,22 @@ lc_getTotalMemory() {
     return (usermemlen == sizeof(uint64_t)) ?
                 *(uint64_t *)usermembuf : *(uint32_t *)usermembuf;
 }
+
+/* NUMA nodes are not tracked */
+void
+lc_numaInit(struct gfs *gfs) {
+    gfs->gfs_nodes = 1;
+    gfs->gfs_node = -1;
+}
+
+/* Binding to NUMA nodes is not supported */
+int
+lc_numaBind(struct gfs *gfs, int node) {
+    return ENOTSUP;
+}
+
+/* Return the only NUMA node */
+int
+lc_numaNode(struct gfs *gfs) {
+    return 0;
+}
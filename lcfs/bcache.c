@@ -64,6 +64,26 @@ lc_removePageFromFreeList(struct lbcache *lbcache, struct page *page) {
     page->p_fprev = NULL;
 }
 
+/* Record the NUMA node holding the data of a page, when the page is given a
+ * new data buffer.  When bound to a node, all buffers come from that node.
+ * Otherwise, the node of the thread handing over the buffer is taken.
+ */
+static inline void
+lc_setPageNode(struct gfs *gfs, struct page *page) {
+    if (gfs->gfs_nodes > 1) {
+        page->p_node = (gfs->gfs_node >= 0) ? gfs->gfs_node :
+                                              lc_numaNode(gfs);
+    }
+}
+
+/* Count a cache hit on a page */
+static inline void
+lc_pageHit(struct page *page) {
+    if (page->p_hitCount < LC_PAGE_HITS_MAX) {
+        page->p_hitCount++;
+    }
+}
+
 /* Allocate a new page. Memory is counted against the base layer */
 static struct page *
 lc_newPage(struct gfs *gfs, struct fs *fs) {
@@ -73,10 +93,12 @@ lc_newPage(struct gfs *gfs, struct fs *fs) {
     page->p_block = LC_INVALID_BLOCK;
     page->p_refCount = 1;
     page->p_hitCount = 0;
+    page->p_node = 0;
     page->p_nohash = 0;
     page->p_nofree = 0;
     page->p_cache = 0;
     page->p_nocache = 0;
+    page->p_pinned = 0;
     page->p_dvalid = 0;
     page->p_cnext = NULL;
     page->p_dnext = NULL;
@@ -109,6 +131,9 @@ lc_freePage(struct gfs *gfs, struct fs *fs, struct page *page) {
     if (page->p_data && !page->p_nofree) {
         lc_freePageData(gfs, fs->fs_rfs, page->p_data);
     }
+    if (page->p_pinned) {
+        __sync_sub_and_fetch(&gfs->gfs_ppinned, 1);
+    }
     lc_free(fs->fs_rfs, page, sizeof(struct page), LC_MEMTYPE_PAGE);
     __sync_sub_and_fetch(&fs->fs_bcache->lb_pcount, 1);
     __sync_sub_and_fetch(&gfs->gfs_pcount, 1);
@@ -140,6 +165,13 @@ lc_bcacheInit(struct fs *fs, uint32_t count, uint32_t lcount) {
     lbcache->lb_pcacheSize = count;
     lbcache->lb_pcacheLockCount = lcount;
     lbcache->lb_pcount = 0;
+    lbcache->lb_target = 0;
+    lbcache->lb_weight = 0;
+    lbcache->lb_hits = 0;
+    lbcache->lb_misses = 0;
+    lbcache->lb_lhits = 0;
+    lbcache->lb_lmisses = 0;
+    lbcache->lb_purged = 0;
     fs->fs_bcache = lbcache;
 }
 
@@ -348,7 +380,7 @@ lc_releasePage(struct gfs *gfs, struct fs *fs, struct page *page, bool read,
     } else if (read) {
 
         /* If page was read, increment hit count */
-        page->p_hitCount++;
+        lc_pageHit(page);
     }
     lc_pcUnLockHash(fs, lhash);
 
@@ -438,6 +470,10 @@ lc_invalPage(struct gfs *gfs, struct fs *fs, uint64_t block) {
     while (page) {
         if (page->p_block == block) {
             page->p_cache = 0;
+            if (page->p_pinned) {
+                page->p_pinned = 0;
+                __sync_sub_and_fetch(&gfs->gfs_ppinned, 1);
+            }
             if (page->p_refCount) {
 
                 /* Mark the page for delayed invalidation */
@@ -462,6 +498,87 @@ lc_invalPage(struct gfs *gfs, struct fs *fs, uint64_t block) {
     return ret;
 }
 
+/* Check if a page for the block is present in cache */
+bool
+lc_pageCached(struct fs *fs, uint64_t block) {
+    struct pcache *pcache = fs->fs_bcache->lb_pcache;
+    int hash = lc_pageBlockHash(fs, block);
+    struct page *page;
+    uint32_t lhash;
+
+    if (pcache[hash].pc_head == NULL) {
+        return false;
+    }
+    lhash = lc_pcLockHash(fs, hash);
+    page = pcache[hash].pc_head;
+    while (page && (page->p_block != block)) {
+        page = page->p_cnext;
+    }
+    lc_pcUnLockHash(fs, lhash);
+    return page != NULL;
+}
+
+/* Pin pages read from a pinned file or layer, within the limit for pinned
+ * pages.  Pinned pages are not purged and not invalidated when released.
+ */
+void
+lc_pinPages(struct gfs *gfs, struct fs *fs, struct page **pages,
+            uint64_t pcount) {
+    struct page *page;
+    uint32_t lhash;
+    uint64_t i;
+
+    for (i = 0; i < pcount; i++) {
+        page = pages[i];
+        if (page->p_cache) {
+            continue;
+        }
+        if (gfs->gfs_ppinned >= gfs->gfs_pinLimit) {
+            __sync_add_and_fetch(&gfs->gfs_pinDenied, pcount - i);
+            break;
+        }
+        lhash = lc_pcLockHash(fs, lc_pageBlockHash(fs, page->p_block));
+        if (!page->p_cache && !page->p_nocache) {
+            page->p_cache = 1;
+            page->p_pinned = 1;
+            __sync_add_and_fetch(&gfs->gfs_ppinned, 1);
+        }
+        lc_pcUnLockHash(fs, lhash);
+    }
+}
+
+/* Unpin pages pinned in the cache of a layer tree.  Pages of files and layers
+ * which remain pinned are pinned again when read next time.
+ */
+void
+lc_unpinPages(struct gfs *gfs, struct fs *fs) {
+    struct lbcache *lbcache = fs->fs_bcache;
+    struct pcache *pcache = lbcache->lb_pcache;
+    uint32_t i, lhash;
+    uint64_t count = 0;
+    struct page *page;
+
+    for (i = 0; i < lbcache->lb_pcacheSize; i++) {
+        if (pcache[i].pc_head == NULL) {
+            continue;
+        }
+        lhash = lc_pcLockHash(fs, i);
+        page = pcache[i].pc_head;
+        while (page) {
+            if (page->p_pinned) {
+                page->p_pinned = 0;
+                page->p_cache = 0;
+                count++;
+            }
+            page = page->p_cnext;
+        }
+        lc_pcUnLockHash(fs, lhash);
+    }
+    if (count) {
+        __sync_sub_and_fetch(&gfs->gfs_ppinned, count);
+    }
+}
+
 /* Set block number on a page */
 void
 lc_setPageBlock(struct page *page, uint64_t block) {
@@ -579,10 +696,12 @@ retry:
         if (!page->p_dvalid) {
             if (data) {
                 page->p_data = data;
+                lc_setPageNode(gfs, page);
             } else {
                 if (page->p_data == NULL) {
                     lc_mallocBlockAligned(fs->fs_rfs, (void **)&page->p_data,
                                           LC_MEMTYPE_DATA);
+                    lc_setPageNode(gfs, page);
                 }
                 lc_readBlock(gfs, fs, block, page->p_data);
                 page->p_dvalid = 1;
@@ -597,8 +716,19 @@ retry:
     assert(page->p_block == block);
     if (missed) {
         __sync_add_and_fetch(&gfs->gfs_pmissed, 1);
+        __sync_add_and_fetch(&fs->fs_bcache->lb_misses, 1);
     } else if (hit) {
         __sync_add_and_fetch(&gfs->gfs_phit, 1);
+        __sync_add_and_fetch(&fs->fs_bcache->lb_hits, 1);
+
+        /* Track hits on pages allocated on other NUMA nodes */
+        if (gfs->gfs_nodes > 1) {
+            if (page->p_node == lc_numaNode(gfs)) {
+                __sync_add_and_fetch(&gfs->gfs_plocal, 1);
+            } else {
+                __sync_add_and_fetch(&gfs->gfs_premote, 1);
+            }
+        }
     }
     return page;
 }
@@ -618,6 +748,7 @@ lc_getPageNew(struct gfs *gfs, struct fs *fs, uint64_t block, char *data) {
     page->p_dvalid = 1;
     page->p_hitCount = 0;
     page->p_nocache = 0;
+    lc_setPageNode(gfs, page);
     return page;
 }
 
@@ -633,6 +764,7 @@ lc_getPageNoBlock(struct gfs *gfs, struct fs *fs, char *data,
     page->p_data = data;
     page->p_dvalid = 1;
     page->p_dnext = prev;
+    lc_setPageNode(gfs, page);
     return page;
 }
 
@@ -648,11 +780,120 @@ lc_getPageNewData(struct fs *fs, uint64_t block, char *data) {
     if ((page->p_data == NULL) && (data == NULL)) {
         lc_mallocBlockAligned(fs->fs_rfs, (void **)&page->p_data,
                               LC_MEMTYPE_DATA);
+        lc_setPageNode(fs->fs_gfs, page);
     }
     page->p_nocache = 0;
     return page;
 }
 
+/* Fill up a page of a compressed file by decompressing the cluster of pages
+ * it belongs to.  Other pages of the cluster are added to the cache as well.
+ * Return number of pages filled up.
+ */
+static uint32_t
+lc_readCompressedPage(struct gfs *gfs, struct fs *fs, struct page *page) {
+    struct page *bpages[LC_COMPRESS_CBLOCKS], *rpages[LC_COMPRESS_CBLOCKS];
+    uint32_t i, pg, off, size, len, count, bcount = 0, pcount, rcount = 0;
+    uint64_t key = page->p_block, block, bstart, first;
+    struct page *hpage, *cpage;
+    struct dzfile *dzfile;
+    char *zbuf, *data;
+    uint32_t lhash;
+    uLongf dsize;
+    int err;
+
+    if (page->p_dvalid) {
+        return 0;
+    }
+    block = (key & ~LC_PAGE_COMPRESSED) >> LC_COMPRESS_SHIFT;
+    pg = key & (LC_COMPRESS_MAX_PAGES - 1);
+    first = key - (pg % LC_COMPRESS_CLUSTER);
+
+    /* Locate the cluster using the header in the first block of the file */
+    hpage = lc_getPage(fs, block, NULL, true);
+    dzfile = (struct dzfile *)hpage->p_data;
+    assert(dzfile->dz_magic == LC_COMPRESS_MAGIC);
+    if (pg >= dzfile->dz_pages) {
+
+        /* Pages past the data compressed are added when file is extended */
+        lc_releasePage(gfs, fs, hpage, true, false);
+        lhash = lc_lockPageRead(fs, key);
+        if (!page->p_dvalid) {
+            memset(page->p_data, 0, LC_BLOCK_SIZE);
+            page->p_dvalid = 1;
+            rcount = 1;
+        }
+        lc_unlockPageRead(fs, lhash);
+        return rcount;
+    }
+    i = pg / LC_COMPRESS_CLUSTER;
+    off = dzfile->dz_offset[i];
+    size = dzfile->dz_offset[i + 1] - off;
+    pcount = dzfile->dz_pages - (i * LC_COMPRESS_CLUSTER);
+    if (pcount > LC_COMPRESS_CLUSTER) {
+        pcount = LC_COMPRESS_CLUSTER;
+    }
+    lc_releasePage(gfs, fs, hpage, true, false);
+
+    /* Read in blocks with compressed data, which may be in cache if the file
+     * was written recently.
+     */
+    bstart = block + (off / LC_BLOCK_SIZE);
+    off %= LC_BLOCK_SIZE;
+    count = (off + size + LC_BLOCK_SIZE - 1) / LC_BLOCK_SIZE;
+    assert(count <= LC_COMPRESS_CBLOCKS);
+    for (i = 0; i < count; i++) {
+        bpages[i] = lc_getPageNewData(fs, bstart + i, NULL);
+        if (!bpages[i]->p_dvalid) {
+            rpages[bcount++] = bpages[i];
+        }
+    }
+    if (bcount) {
+        lc_readPages(gfs, fs, rpages, bcount);
+    }
+    zbuf = lc_malloc(fs->fs_rfs, (LC_COMPRESS_CLUSTER + LC_COMPRESS_CBLOCKS) *
+                                 LC_BLOCK_SIZE, LC_MEMTYPE_ZBUF);
+    data = &zbuf[LC_COMPRESS_CLUSTER * LC_BLOCK_SIZE];
+    for (i = 0, len = 0; i < count; i++) {
+        bcount = LC_BLOCK_SIZE - off;
+        if (bcount > (size - len)) {
+            bcount = size - len;
+        }
+        memcpy(&data[len], &bpages[i]->p_data[off], bcount);
+        len += bcount;
+        off = 0;
+
+        /* Keep the block with the header in cache */
+        lc_releasePage(gfs, fs, bpages[i], true, (bstart + i) != block);
+    }
+    assert(len == size);
+    dsize = pcount * LC_BLOCK_SIZE;
+    err = uncompress((Bytef *)zbuf, &dsize, (Bytef *)data, size);
+    assert((err == Z_OK) && (dsize == (pcount * LC_BLOCK_SIZE)));
+
+    /* Fill up pages of the cluster not in cache already */
+    lhash = lc_lockPageRead(fs, key);
+    for (i = 0; i < pcount; i++) {
+        cpage = ((first + i) == key) ? page :
+                                       lc_getPageNewData(fs, first + i, NULL);
+        if (!cpage->p_dvalid) {
+            memcpy(cpage->p_data, &zbuf[i * LC_BLOCK_SIZE], LC_BLOCK_SIZE);
+            cpage->p_dvalid = 1;
+            if (cpage == page) {
+                rcount = 1;
+            }
+        }
+        if (cpage != page) {
+            lc_releasePage(gfs, fs, cpage, false, false);
+        }
+    }
+    lc_unlockPageRead(fs, lhash);
+    lc_free(fs->fs_rfs, zbuf, (LC_COMPRESS_CLUSTER + LC_COMPRESS_CBLOCKS) *
+                              LC_BLOCK_SIZE, LC_MEMTYPE_ZBUF);
+    __sync_add_and_fetch(&gfs->gfs_zreads, 1);
+    return rcount;
+}
+
 /* Read in a cluster of blocks */
 uint32_t
 lc_readPages(struct gfs *gfs, struct fs *fs, struct page **pages,
@@ -663,6 +904,25 @@ lc_readPages(struct gfs *gfs, struct fs *fs, struct page **pages,
     struct iovec *iovec;
     uint32_t lhash;
 
+    /* Pages of compressed files are filled up by decompressing data, and
+     * taken out of the list.
+     */
+    for (i = 0; i < count; i++) {
+        if (lc_isCompressedBlock(pages[i]->p_block)) {
+            rcount += lc_readCompressedPage(gfs, fs, pages[i]);
+        } else {
+            pages[j++] = pages[i];
+        }
+    }
+    if (j < count) {
+        if (j == 0) {
+            return rcount;
+        }
+        count = j;
+        page = pages[0];
+    }
+    j = 0;
+
     /* Use pread(2) interface if there is just one block to read */
     if (count == 1) {
 
@@ -755,6 +1015,10 @@ lc_flushPageCluster(struct gfs *gfs, struct fs *fs,
     /* Mark superblock dirty before modifying something */
     lc_markSuperDirty(fs);
 
+    /* Charge the writes against I/O limits of the layer */
+    lc_qosCharge(fs, (count + LC_WRITE_CLUSTER_SIZE - 1) /
+                     LC_WRITE_CLUSTER_SIZE, count * LC_BLOCK_SIZE, false);
+
     /* Use pwrite(2) interface if there is just one block */
     if (count == 1) {
         block = page->p_block;
@@ -870,6 +1134,7 @@ lc_flusher(void *data) {
     bool force;
     int i;
 
+    lc_ioSetClass(LC_IO_WRITEBACK);
     interval.tv_nsec = 0;
     while (!gfs->gfs_unmounting) {
         gettimeofday(&now, NULL);
@@ -890,6 +1155,9 @@ lc_flusher(void *data) {
             force = !lc_checkMemoryAvailable(true) ||
                     gfs->gfs_pcleaning || gfs->gfs_pcleaningForced;
 
+            /* Writers may be waiting for memory, do not defer writes then */
+            lc_ioSetClass(force ? LC_IO_SYNC : LC_IO_WRITEBACK);
+
             /* Skip newly created layers */
             gettimeofday(&now, NULL);
             recent = now.tv_sec - LC_FLUSH_TIME;
@@ -956,6 +1224,234 @@ lc_wakeupCleaner(struct gfs *gfs, bool wait) {
     pthread_mutex_unlock(&gfs->gfs_clock);
 }
 
+/* Return the image layer a layer is created from */
+struct fs *
+lc_getImageLayer(struct fs *fs) {
+    while (fs && !fs->fs_readOnly) {
+        fs = fs->fs_parent;
+    }
+    return fs;
+}
+
+/* Start recording reads of a new container in the manifest of the image
+ * layer it is created from, unless recorded before.  Return the manifest if
+ * one is available for prefetching.
+ */
+struct manifest *
+lc_manifestInit(struct fs *fs, struct fs *ifs) {
+    struct manifest *manifest = ifs->fs_manifest;
+
+    if (manifest) {
+        return (time(NULL) >= manifest->m_end) ? manifest : NULL;
+    }
+    manifest = lc_malloc(ifs, sizeof(struct manifest), LC_MEMTYPE_MANIFEST);
+    pthread_mutex_init(&manifest->m_lock, NULL);
+    manifest->m_blocks = lc_malloc(ifs, LC_MANIFEST_MAX * sizeof(uint64_t),
+                                   LC_MEMTYPE_MANIFEST);
+    manifest->m_hash = lc_malloc(ifs, LC_MANIFEST_HASH_SIZE * sizeof(uint64_t),
+                                 LC_MEMTYPE_MANIFEST);
+    memset(manifest->m_hash, 0, LC_MANIFEST_HASH_SIZE * sizeof(uint64_t));
+    manifest->m_end = time(NULL) + LC_MANIFEST_TIME;
+    manifest->m_count = 0;
+    manifest->m_prefetched = 0;
+
+    /* Another container created from the same image may be recording */
+    if (__sync_bool_compare_and_swap(&ifs->fs_manifest, NULL, manifest)) {
+        fs->fs_mrecord = manifest;
+    } else {
+        lc_manifestFree(ifs, manifest);
+    }
+    return NULL;
+}
+
+/* Add a block to the hash table of blocks recorded.  Returns false if the
+ * block was recorded before.
+ */
+static bool
+lc_manifestAdd(struct manifest *manifest, uint64_t block) {
+    uint64_t i = block % LC_MANIFEST_HASH_SIZE;
+
+    while (manifest->m_hash[i]) {
+        if (manifest->m_hash[i] == block) {
+            return false;
+        }
+        i = (i + 1) % LC_MANIFEST_HASH_SIZE;
+    }
+    manifest->m_hash[i] = block;
+    return true;
+}
+
+/* Record blocks of an image read by a new container, whether those are found
+ * in the cache or read from disk, so that the manifest is complete even when
+ * the image was read by other containers before.
+ */
+void
+lc_manifestRecord(struct fs *fs, struct page **pages, uint32_t count) {
+    struct manifest *manifest = fs->fs_mrecord;
+    uint64_t block;
+    uint32_t i;
+
+    if (time(NULL) >= manifest->m_end) {
+        fs->fs_mrecord = NULL;
+        lc_printf("Recorded %d blocks for layer %d\n",
+                  manifest->m_count, fs->fs_gindex);
+        return;
+    }
+    pthread_mutex_lock(&manifest->m_lock);
+    for (i = 0; (i < count) && (manifest->m_count < LC_MANIFEST_MAX); i++) {
+        block = pages[i]->p_block;
+        if (lc_manifestAdd(manifest, block)) {
+            manifest->m_blocks[manifest->m_count++] = block;
+        }
+    }
+    pthread_mutex_unlock(&manifest->m_lock);
+}
+
+/* Free a manifest */
+void
+lc_manifestFree(struct fs *fs, struct manifest *manifest) {
+#ifdef LC_MUTEX_DESTROY
+    pthread_mutex_destroy(&manifest->m_lock);
+#endif
+    lc_free(fs, manifest->m_blocks, LC_MANIFEST_MAX * sizeof(uint64_t),
+            LC_MEMTYPE_MANIFEST);
+    lc_free(fs, manifest->m_hash, LC_MANIFEST_HASH_SIZE * sizeof(uint64_t),
+            LC_MEMTYPE_MANIFEST);
+    lc_free(fs, manifest, sizeof(struct manifest), LC_MEMTYPE_MANIFEST);
+}
+
+/* Lock an image layer being prefetched shared, if the layer still exists */
+static struct fs *
+lc_prefetchLayer(struct gfs *gfs, struct prefetch *prefetch) {
+    struct fs *fs;
+
+    rcu_read_lock();
+    fs = rcu_dereference(gfs->gfs_fs[prefetch->pf_gindex]);
+    if (fs && ((fs->fs_root != prefetch->pf_root) || lc_tryLock(fs, false))) {
+        fs = NULL;
+    }
+    rcu_read_unlock();
+    if (fs && (fs->fs_removed || (fs->fs_root != prefetch->pf_root))) {
+        lc_unlock(fs);
+        fs = NULL;
+    }
+    return fs;
+}
+
+/* Account a prefetch thread exiting, waking up unmount after the last one */
+static void
+lc_prefetchDone(struct gfs *gfs) {
+    pthread_mutex_lock(&gfs->gfs_pflock);
+    if (__sync_sub_and_fetch(&gfs->gfs_prefetchers, 1) == 0) {
+        pthread_cond_signal(&gfs->gfs_prefetchCond);
+    }
+    pthread_mutex_unlock(&gfs->gfs_pflock);
+}
+
+/* Read blocks recorded in a manifest into the page cache, ahead of reads
+ * from a new container.  Blocks are read in batches, sorted within each batch
+ * for clustering reads, and stops if running low on memory.  The image layer
+ * is locked only while reading a batch, and reads are issued at the priority
+ * of application reads, as those are done for the container starting.
+ */
+static void *
+lc_prefetcher(void *data) {
+    struct page *pages[LC_READ_CLUSTER_SIZE], *rpages[LC_READ_CLUSTER_SIZE];
+    uint32_t i, j, k, count = 0, bcount, pcount, rcount, total = 0;
+    struct prefetch *prefetch = (struct prefetch *)data;
+    uint64_t blocks[LC_READ_CLUSTER_SIZE], block;
+    struct gfs *gfs = prefetch->pf_gfs;
+    struct manifest *manifest;
+    struct fs *fs;
+
+    rcu_register_thread();
+    for (i = 0; !gfs->gfs_unmounting; i += bcount) {
+        fs = lc_prefetchLayer(gfs, prefetch);
+        if (fs == NULL) {
+            break;
+        }
+        manifest = fs->fs_manifest;
+        if (i == 0) {
+            pthread_mutex_lock(&manifest->m_lock);
+            count = manifest->m_count;
+            pthread_mutex_unlock(&manifest->m_lock);
+            __sync_add_and_fetch(&manifest->m_prefetched, 1);
+        }
+        if ((i >= count) || !lc_checkMemoryAvailable(true)) {
+            lc_unlock(fs);
+            break;
+        }
+        bcount = count - i;
+        if (bcount > LC_READ_CLUSTER_SIZE) {
+            bcount = LC_READ_CLUSTER_SIZE;
+        }
+
+        /* Sort the batch, skipping duplicates */
+        pcount = 0;
+        for (j = 0; j < bcount; j++) {
+            block = manifest->m_blocks[i + j];
+            for (k = pcount; (k > 0) && (blocks[k - 1] > block); k--) {
+                blocks[k] = blocks[k - 1];
+            }
+            if ((k == 0) || (blocks[k - 1] != block)) {
+                blocks[k] = block;
+                pcount++;
+            } else {
+                memmove(&blocks[k], &blocks[k + 1],
+                        (pcount - k) * sizeof(uint64_t));
+            }
+        }
+
+        /* Read pages not in cache already */
+        rcount = 0;
+        for (j = 0; j < pcount; j++) {
+            pages[j] = lc_getPageNewData(fs, blocks[j], NULL);
+            if (!pages[j]->p_dvalid) {
+                rpages[rcount++] = pages[j];
+            }
+        }
+        if (rcount) {
+            total += lc_readPages(gfs, fs, rpages, rcount);
+        }
+        lc_releaseReadPages(gfs, fs, pages, pcount, false, true);
+        lc_unlock(fs);
+    }
+    rcu_unregister_thread();
+    lc_printf("Prefetched %d of %d blocks for layer %d\n",
+              total, count, prefetch->pf_gindex);
+    lc_free(NULL, prefetch, sizeof(struct prefetch), LC_MEMTYPE_GFS);
+    lc_prefetchDone(gfs);
+    return NULL;
+}
+
+/* Start prefetching blocks recorded in the manifest of an image layer in a
+ * background thread, so that the request creating the container is not held
+ * up and no locks are held while the blocks are read.
+ */
+void
+lc_prefetch(struct gfs *gfs, struct fs *fs) {
+    struct prefetch *prefetch;
+    pthread_attr_t attr;
+    pthread_t tid;
+    int err;
+
+    prefetch = lc_malloc(NULL, sizeof(struct prefetch), LC_MEMTYPE_GFS);
+    prefetch->pf_gfs = gfs;
+    prefetch->pf_root = fs->fs_root;
+    prefetch->pf_gindex = fs->fs_gindex;
+    __sync_add_and_fetch(&gfs->gfs_prefetchers, 1);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&tid, &attr, lc_prefetcher, prefetch);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        lc_syslog(LOG_ERR, "Failed to start prefetch for layer %d, err %d\n",
+                  fs->fs_gindex, err);
+        lc_free(NULL, prefetch, sizeof(struct prefetch), LC_MEMTYPE_GFS);
+        lc_prefetchDone(gfs);
+    }
+}
+
 /* Purge some pages of a tree of layers */
 static uint64_t
 lc_purgeTreePages(struct gfs *gfs, struct fs *fs, uint64_t *blocks,
@@ -975,7 +1471,7 @@ lc_purgeTreePages(struct gfs *gfs, struct fs *fs, uint64_t *blocks,
     pthread_mutex_lock(&lbcache->lb_flock);
     page = lbcache->lb_fhead;
     while (page && (pcount < LC_PAGE_PURGE_COUNT)) {
-        if ((page->p_block != LC_INVALID_BLOCK) &&
+        if ((page->p_block != LC_INVALID_BLOCK) && !page->p_pinned &&
             (all || (page->p_refCount == 0))) {
             if (!all && page->p_hitCount) {
                 page->p_hitCount--;
@@ -989,6 +1485,94 @@ lc_purgeTreePages(struct gfs *gfs, struct fs *fs, uint64_t *blocks,
     while (pcount && !fs->fs_removed) {
         count += lc_invalPage(gfs, fs, blocks[--pcount]);
     }
+    if (count) {
+        __sync_add_and_fetch(&lbcache->lb_purged, count);
+    }
+    return count;
+}
+
+/* Divide the global page budget among block caches of layer trees, in
+ * proportion to recent hits and misses on each cache, so that a busy image
+ * could keep more pages cached than images not being used.
+ */
+static void
+lc_balanceCaches(struct gfs *gfs) {
+    uint64_t budget = lc_memoryPageBudget(), total = 0, count = 0;
+    uint64_t hits, misses, recent;
+    struct lbcache *lbcache;
+    time_t now = time(NULL);
+    struct fs *fs;
+    int i;
+
+    if ((now - gfs->gfs_balanceTime) < LC_BCACHE_BALANCE_INTERVAL) {
+        return;
+    }
+    gfs->gfs_balanceTime = now;
+    rcu_read_lock();
+
+    /* Find activity on each cache since last time, decaying older activity */
+    for (i = 0; i <= gfs->gfs_scount; i++) {
+        fs = rcu_dereference(gfs->gfs_fs[i]);
+        if ((fs == NULL) || fs->fs_parent || fs->fs_removed) {
+            continue;
+        }
+        lbcache = fs->fs_bcache;
+        hits = lbcache->lb_hits;
+        misses = lbcache->lb_misses;
+        recent = (hits - lbcache->lb_lhits) + (misses - lbcache->lb_lmisses);
+        lbcache->lb_lhits = hits;
+        lbcache->lb_lmisses = misses;
+        lbcache->lb_weight = (lbcache->lb_weight + recent) / 2;
+        total += lbcache->lb_weight;
+        count++;
+    }
+
+    /* Caches without any recent activity get an equal small share */
+    for (i = 0; count && (i <= gfs->gfs_scount); i++) {
+        fs = rcu_dereference(gfs->gfs_fs[i]);
+        if ((fs == NULL) || fs->fs_parent || fs->fs_removed) {
+            continue;
+        }
+        lbcache = fs->fs_bcache;
+        lbcache->lb_target = (budget * (lbcache->lb_weight + 1)) /
+                             (total + count);
+    }
+    rcu_read_unlock();
+}
+
+/* Purge pages from trees of layers caching more pages than their share of
+ * the budget, until memory usage is under the limit.
+ */
+static uint64_t
+lc_purgeOverTarget(struct gfs *gfs, uint64_t *blocks) {
+    uint64_t count = 0, tcount;
+    struct lbcache *lbcache;
+    struct fs *fs;
+    int i;
+
+    rcu_read_lock();
+    for (i = 0; (i <= gfs->gfs_scount) &&
+                !lc_checkMemoryAvailable(true); i++) {
+        fs = rcu_dereference(gfs->gfs_fs[i]);
+        if ((fs == NULL) || fs->fs_parent ||
+            (fs->fs_bcache->lb_pcount <= fs->fs_bcache->lb_target) ||
+            lc_tryLock(fs, false)) {
+            continue;
+        }
+        rcu_read_unlock();
+        lbcache = fs->fs_bcache;
+        do {
+            tcount = lc_purgeTreePages(gfs, fs, blocks, true);
+            count += tcount;
+        } while (tcount && (lbcache->lb_pcount > lbcache->lb_target) &&
+                 !lc_checkMemoryAvailable(true));
+        lc_unlock(fs);
+        rcu_read_lock();
+    }
+    rcu_read_unlock();
+    if (count && lc_checkMemoryAvailable(false)) {
+        pthread_cond_broadcast(&gfs->gfs_mcond);
+    }
     return count;
 }
 
@@ -1003,6 +1587,12 @@ lc_purgePages(struct gfs *gfs, bool force) {
     rcu_register_thread();
 
 retry:
+    lc_balanceCaches(gfs);
+
+    /* Shrink caches of trees using more than their share first, before
+     * purging pages from all trees.
+     */
+    pcount = lc_purgeOverTarget(gfs, blocks);
     rcu_read_lock();
     for (i = 0; i <= gfs->gfs_scount; i++) {
 
@@ -1064,6 +1654,7 @@ lc_cleaner(void) {
     /* Purge clean pages when amount of memory used for pages goes above a
      * certain threshold.
      */
+    lc_ioSetClass(LC_IO_BACKGROUND);
     interval.tv_nsec = 0;
     while (!gfs->gfs_unmounting) {
         gettimeofday(&now, NULL);
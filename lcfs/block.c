@@ -11,6 +11,9 @@
 /* Minimum number of blocks attempted to reclaim in one pass */
 #define LC_RECLAIM_BLOCKS   10
 
+/* Number of blocks reserved at a time for metadata written during a sync */
+#define LC_META_ARENA_SIZE  LC_WRITE_CLUSTER_SIZE
+
 /* Initializes the block allocator */
 void
 lc_blockAllocatorInit(struct gfs *gfs, struct fs *fs) {
@@ -111,6 +114,84 @@ lc_hasSpace(struct gfs *gfs, bool root, bool layer) {
     return super->sb_tblocks > (super->sb_blocks + gfs->gfs_dcount + min);
 }
 
+/* Return the number of blocks in use by a layer, including dirty pages yet to
+ * be allocated blocks.
+ */
+static uint64_t
+lc_quotaUsage(struct fs *fs) {
+    uint64_t blocks = fs->fs_blocks, freed = fs->fs_freed;
+
+    return ((blocks > freed) ? (blocks - freed) : 0) + fs->fs_pcount;
+}
+
+/* Check if a layer is within its limits on blocks and inodes.  Usage is
+ * maintained as blocks are allocated and freed, so this does not need any
+ * locks.
+ */
+bool
+lc_quotaAvailable(struct fs *fs, bool inode) {
+    if (fs->fs_blockLimit && (lc_quotaUsage(fs) > fs->fs_blockLimit)) {
+        __sync_add_and_fetch(&fs->fs_quotaDenied, 1);
+        return false;
+    }
+    if (inode && fs->fs_inodeLimit &&
+        ((fs->fs_icount - fs->fs_ricount) >= fs->fs_inodeLimit)) {
+        __sync_add_and_fetch(&fs->fs_quotaDenied, 1);
+        return false;
+    }
+    return true;
+}
+
+/* Check if a write of pcount pages, already counted as dirty pages, keeps the
+ * layer within its limit on blocks.  Pages of the write which replace dirty
+ * pages or blocks allocated in the layer do not add to the usage, as replaced
+ * blocks are freed at the next checkpoint.  Called with the inode locked.
+ */
+bool
+lc_quotaWrite(struct inode *inode, off_t off, size_t size, uint64_t pcount) {
+    struct fs *fs = inode->i_fs;
+    uint64_t usage, count;
+
+    if (!fs->fs_blockLimit) {
+        return true;
+    }
+    usage = lc_quotaUsage(fs);
+    if (usage <= fs->fs_blockLimit) {
+        return true;
+    }
+
+    /* Do not charge pages which do not need new blocks */
+    count = lc_newPageCount(inode, off, size);
+    assert(count <= pcount);
+    if (count && ((usage - (pcount - count)) > fs->fs_blockLimit)) {
+        __sync_add_and_fetch(&fs->fs_quotaDenied, 1);
+        return false;
+    }
+    return true;
+}
+
+/* Check if a block was allocated in the layer, and thus freed when replaced */
+bool
+lc_layerBlockAllocated(struct fs *fs, uint64_t block) {
+    struct extent *extent;
+    bool found = false;
+
+    /* All blocks of the global layer are accounted to it */
+    if (fs == lc_getGlobalFs(fs->fs_gfs)) {
+        return true;
+    }
+    pthread_mutex_lock(&fs->fs_alock);
+    extent = fs->fs_aextents;
+    while (extent && !found) {
+        found = (block >= lc_getExtentStart(extent)) &&
+                (block < (lc_getExtentStart(extent) +
+                          lc_getExtentCount(extent)));
+        extent = extent->ex_next;
+    }
+    pthread_mutex_unlock(&fs->fs_alock);
+    return found;
+}
+
 /* Add an extent to an extent list tracking space */
 void
 lc_addSpaceExtent(struct gfs *gfs, struct fs *fs, struct extent **extents,
@@ -507,6 +588,132 @@ lc_blockAllocExact(struct fs *fs, uint64_t count, bool meta, bool reserve) {
     return block;
 }
 
+/* Start allocating metadata blocks from arenas */
+void
+lc_metaArenaBegin(struct fs *fs) {
+    assert(fs->fs_metaPages == NULL);
+    fs->fs_metaArena = true;
+}
+
+/* Queue pages staged in the current arena for writeback in block order and
+ * release any blocks of the arena left unused.
+ */
+static void
+lc_metaArenaRetire(struct gfs *gfs, struct fs *fs) {
+    uint64_t i = fs->fs_metaUsed;
+    struct page *page, *head = NULL;
+
+    if (fs->fs_metaPages == NULL) {
+        return;
+    }
+
+    /* Link the pages in block order so that those are written with few large
+     * writes.
+     */
+    while (i) {
+        i--;
+        page = fs->fs_metaPages[i];
+        assert(page && (page->p_block == (fs->fs_metaBlock + i)));
+        page->p_dnext = head;
+        head = page;
+    }
+    if (head) {
+        lc_addPageForWriteBack(gfs, fs, head,
+                               fs->fs_metaPages[fs->fs_metaUsed - 1],
+                               fs->fs_metaUsed);
+        fs->fs_metaBlocks += fs->fs_metaUsed;
+        fs->fs_metaRuns++;
+    }
+    if (fs->fs_metaUsed < fs->fs_metaCount) {
+        lc_blockFree(gfs, fs, fs->fs_metaBlock + fs->fs_metaUsed,
+                     fs->fs_metaCount - fs->fs_metaUsed, true, true);
+    }
+    lc_free(fs, fs->fs_metaPages, LC_META_ARENA_SIZE * sizeof(struct page *),
+            LC_MEMTYPE_PCACHE);
+    fs->fs_metaPages = NULL;
+    fs->fs_metaBlock = 0;
+    fs->fs_metaCount = 0;
+    fs->fs_metaUsed = 0;
+}
+
+/* Write out the current arena and stop allocating from arenas */
+void
+lc_metaArenaEnd(struct gfs *gfs, struct fs *fs) {
+    lc_metaArenaRetire(gfs, fs);
+    fs->fs_metaArena = false;
+}
+
+/* Allocate blocks for metadata.  During a sync, blocks are handed out from a
+ * contiguous arena, so that small metadata writes of a layer end up next to
+ * each other on disk instead of being scattered among data blocks.  Pages
+ * written to those blocks need to be queued with lc_metaWriteBack() before
+ * allocating any more metadata blocks.
+ */
+uint64_t
+lc_metaAlloc(struct fs *fs, uint64_t count) {
+    uint64_t block;
+
+    if (!fs->fs_metaArena || (count > LC_META_ARENA_SIZE)) {
+        return lc_blockAllocExact(fs, count, true, true);
+    }
+
+    /* Start a new arena if the current one does not have enough room */
+    if (fs->fs_metaPages &&
+        ((fs->fs_metaUsed + count) > fs->fs_metaCount)) {
+        lc_metaArenaRetire(fs->fs_gfs, fs);
+    }
+    if (fs->fs_metaPages == NULL) {
+        block = lc_blockAlloc(fs, LC_META_ARENA_SIZE, true, true);
+        if (block == LC_INVALID_BLOCK) {
+
+            /* Fall back to allocating blocks as needed when free space is
+             * fragmented.
+             */
+            fs->fs_metaArena = false;
+            return lc_blockAllocExact(fs, count, true, true);
+        }
+        fs->fs_metaPages = lc_malloc(fs,
+                                     LC_META_ARENA_SIZE * sizeof(struct page *),
+                                     LC_MEMTYPE_PCACHE);
+        memset(fs->fs_metaPages, 0,
+               LC_META_ARENA_SIZE * sizeof(struct page *));
+        fs->fs_metaBlock = block;
+        fs->fs_metaCount = LC_META_ARENA_SIZE;
+        fs->fs_metaUsed = 0;
+    }
+    block = fs->fs_metaBlock + fs->fs_metaUsed;
+    fs->fs_metaUsed += count;
+    return block;
+}
+
+/* Queue metadata pages for writeback.  Pages with blocks from the current
+ * arena are staged until the arena is written out.
+ */
+void
+lc_metaWriteBack(struct gfs *gfs, struct fs *fs, struct page *head,
+                 struct page *tail, uint64_t pcount) {
+    struct page *page = head, *next;
+    uint64_t block = head->p_block;
+
+    if ((fs->fs_metaPages == NULL) || (block < fs->fs_metaBlock) ||
+        (block >= (fs->fs_metaBlock + fs->fs_metaUsed))) {
+        lc_addPageForWriteBack(gfs, fs, head, tail, pcount);
+        return;
+    }
+    while (page) {
+        next = page->p_dnext;
+        block = page->p_block;
+        assert((block >= fs->fs_metaBlock) &&
+               (block < (fs->fs_metaBlock + fs->fs_metaUsed)));
+        assert(fs->fs_metaPages[block - fs->fs_metaBlock] == NULL);
+        fs->fs_metaPages[block - fs->fs_metaBlock] = page;
+        page->p_dnext = NULL;
+        page = next;
+        pcount--;
+    }
+    assert(pcount == 0);
+}
+
 /* Free file system blocks */
 void
 lc_blockFree(struct gfs *gfs, struct fs *fs, uint64_t block,
@@ -601,6 +808,43 @@ lc_moveExtents(struct fs *fs, struct extent **extents,
     }
 }
 
+/* Release blocks pending reclaim to the list of blocks freed in the layer, so
+ * that a checkpoint has the truncated emap and the freed blocks together.
+ * Cached pages of these blocks are invalidated later by the reclaimer, as
+ * pages are replaced when blocks are reused.  Pages pending invalidation are
+ * left behind if the layer is going away.
+ */
+static void
+lc_releaseReclaimExtents(struct gfs *gfs, struct fs *fs, bool drop) {
+    struct extent *extents, *extent;
+    uint64_t released = 0;
+
+    pthread_mutex_lock(&fs->fs_alock);
+    extents = fs->fs_rextents;
+    fs->fs_rextents = NULL;
+    pthread_mutex_unlock(&fs->fs_alock);
+    for (extent = extents; extent; extent = extent->ex_next) {
+        lc_addFreedBlocks(fs, lc_getExtentStart(extent),
+                          lc_getExtentCount(extent));
+        released += lc_getExtentCount(extent);
+    }
+    if (released) {
+        __sync_add_and_fetch(&gfs->gfs_reclaimedBlocks, released);
+    }
+    if (drop) {
+        if (extents) {
+            lc_blockFreeExtents(gfs, fs, extents, 0);
+        }
+        if (fs->fs_iextents) {
+            lc_blockFreeExtents(gfs, fs, fs->fs_iextents, 0);
+            fs->fs_iextents = NULL;
+        }
+    } else if (extents) {
+        lc_moveExtents(fs, &fs->fs_iextents, extents, false);
+        lc_wakeupReclaimer(gfs);
+    }
+}
+
 /* Process blocks allocated/freed in a layer */
 void
 lc_processLayerBlocks(struct gfs *gfs, struct fs *fs, bool unmount,
@@ -609,6 +853,11 @@ lc_processLayerBlocks(struct gfs *gfs, struct fs *fs, bool unmount,
     /* Release any unused reservation */
     lc_releaseReservedBlocks(gfs, fs);
 
+    /* Release blocks still pending reclaim */
+    if (fs->fs_rextents || fs->fs_iextents) {
+        lc_releaseReclaimExtents(gfs, fs, unmount || remove);
+    }
+
     /* Process blocks freed in layer.  These blocks may or may not be
      * allocated in the layer
      */
@@ -635,6 +884,119 @@ lc_addFreedBlocks(struct fs *fs, uint64_t block, uint64_t count) {
     pthread_mutex_unlock(&fs->fs_alock);
 }
 
+/* Track extents freed from files in a layer, cached pages of which will be
+ * invalidated by the reclaimer before the blocks are freed.
+ */
+void
+lc_addReclaimExtents(struct fs *fs, struct extent *extent) {
+    lc_moveExtents(fs, &fs->fs_rextents, extent, false);
+    lc_wakeupReclaimer(fs->fs_gfs);
+}
+
+/* Invalidate cached pages of blocks in a list, up to the specified number of
+ * blocks, and add those to the list of blocks freed in the layer if requested.
+ * Return number of blocks processed.
+ */
+static uint64_t
+lc_reclaimExtents(struct gfs *gfs, struct fs *fs, struct extent **extents,
+                  bool release, uint64_t max) {
+    uint64_t block, count, processed = 0, icount = 0;
+    struct extent *extent;
+
+    while (*extents && (processed < max)) {
+
+        /* Take blocks from the first extent in the list */
+        pthread_mutex_lock(&fs->fs_alock);
+        extent = *extents;
+        if (extent == NULL) {
+            pthread_mutex_unlock(&fs->fs_alock);
+            break;
+        }
+        block = lc_getExtentStart(extent);
+        count = lc_getExtentCount(extent);
+        if (count > (max - processed)) {
+            count = max - processed;
+            lc_decrExtentCount(gfs, extent, count);
+            lc_incrExtentStart(gfs, extent, count);
+            extent = NULL;
+        } else {
+            *extents = extent->ex_next;
+        }
+        pthread_mutex_unlock(&fs->fs_alock);
+        if (extent) {
+            lc_free(fs, extent, sizeof(struct extent), LC_MEMTYPE_EXTENT);
+        }
+        if (release) {
+            lc_addFreedBlocks(fs, block, count);
+        }
+        processed += count;
+        while (count) {
+            icount += lc_invalPage(gfs, fs, block);
+            block++;
+            count--;
+        }
+    }
+    if (icount) {
+        __sync_add_and_fetch(&gfs->gfs_precycle, icount);
+    }
+    if (release && processed) {
+        __sync_add_and_fetch(&gfs->gfs_reclaimedBlocks, processed);
+    }
+    return processed;
+}
+
+/* Invalidate cached pages of blocks pending reclaim and add those to the list
+ * of blocks freed in the layer, up to the specified number of blocks.  Blocks
+ * already released by a checkpoint only have their pages invalidated.
+ * Return number of blocks processed.
+ */
+uint64_t
+lc_reclaimBlocks(struct gfs *gfs, struct fs *fs, uint64_t max) {
+    uint64_t count;
+
+    count = lc_reclaimExtents(gfs, fs, &fs->fs_rextents, true, max);
+    if (count < max) {
+        count += lc_reclaimExtents(gfs, fs, &fs->fs_iextents, false,
+                                   max - count);
+    }
+    return count;
+}
+
+/* Release a batch of blocks freed from files in all layers.  Layers locked
+ * exclusive are skipped and busy is set, so that those are retried later.
+ * Return true if there may be more work left.
+ */
+bool
+lc_reclaimLayerBlocks(struct gfs *gfs, bool *busy) {
+    bool more = false;
+    struct fs *fs;
+    int i;
+
+    rcu_register_thread();
+    rcu_read_lock();
+    for (i = 0; i <= gfs->gfs_scount; i++) {
+        fs = rcu_dereference(gfs->gfs_fs[i]);
+        if ((fs == NULL) || ((fs->fs_rextents == NULL) &&
+                             (fs->fs_iextents == NULL))) {
+            continue;
+        }
+        if (lc_tryLock(fs, false)) {
+            *busy = true;
+            continue;
+        }
+        rcu_read_unlock();
+        lc_reclaimBlocks(gfs, fs, LC_RECLAIM_DATA_BATCH);
+        if (fs->fs_rextents || fs->fs_iextents) {
+            more = true;
+        }
+        lc_unlock(fs);
+        rcu_read_lock();
+    }
+    rcu_read_unlock();
+    rcu_unregister_thread();
+    return more;
+}
+
 /* Track a list of extents freed from a layer */
 void
 lc_addFreedExtents(struct fs *fs, struct extent *extent, bool empty) {
@@ -783,7 +1145,14 @@ lc_processFreeExtents(struct gfs *gfs, struct fs *fs, bool umount) {
     }
 }
 
-/* Grow the size of a file system */
+/* Grow the size of a file system.
+ * New space is published to the allocator while holding the root layer
+ * shared, so that operations in progress are not blocked.  Shared lock keeps
+ * the new size and the free extent list from reaching the disk separately,
+ * as those are written out together while holding the root layer exclusive.
+ * If the file system goes down before that, grow is done again during the
+ * next mount.
+ */
 void
 lc_grow(struct gfs *gfs) {
     struct super *super = gfs->gfs_super;
@@ -791,25 +1160,34 @@ lc_grow(struct gfs *gfs) {
     uint64_t block, oblock;
     size_t size;
 
-    oblock = super->sb_tblocks;
     size = lseek(gfs->gfs_fd, 0, SEEK_END);
     assert(size != -1);
-    assert(size >= (oblock * LC_BLOCK_SIZE));
     block = size / LC_BLOCK_SIZE;
+    if (block <= super->sb_tblocks) {
+        return;
+    }
+    lc_lock(fs, false);
+    pthread_mutex_lock(&gfs->gfs_alock);
+
+    /* Check again as another thread could have grown the file system */
+    oblock = super->sb_tblocks;
+    assert(size >= (oblock * LC_BLOCK_SIZE));
     if (block <= oblock) {
+        pthread_mutex_unlock(&gfs->gfs_alock);
+        lc_unlock(fs);
         return;
     }
     lc_printf("Growing file system, old size %ld new size %ld\n",
               oblock * LC_BLOCK_SIZE, size);
-    lc_lockExclusive(fs);
-    pthread_mutex_lock(&gfs->gfs_alock);
+
+    /* Update size before making new blocks available for allocation */
     super->sb_tblocks = block;
     lc_addSpaceExtent(gfs, fs, &gfs->gfs_extents, oblock, block - oblock,
                       true);
     gfs->gfs_blocksReserved = (super->sb_tblocks * LC_RESERVED_BLOCKS) / 100ul;
-    pthread_mutex_unlock(&gfs->gfs_alock);
     lc_markExtentsDirty(fs);
     lc_markSuperDirty(fs);
-    lc_unlockExclusive(fs);
+    pthread_mutex_unlock(&gfs->gfs_alock);
+    lc_unlock(fs);
 }
 
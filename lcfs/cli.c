@@ -43,7 +43,7 @@ cmd_group lcfs_cmd_group[] = {
 #ifndef __MUSL__
             "[-p] "
 #endif
-            "[-f] [-d] [-m] [-r] [-t] [-v]",
+            "[-f] [-d] [-m] [-r] [-t] [-a] [-z[level]] [-n[node]] [-v]",
         "\tdevice     - device or file - image layers will be saved here\n"
         "\thost-mount - mount point on host\n"
         "\thost-mount - mount point propogated to the plugin\n"
@@ -57,6 +57,12 @@ cmd_group lcfs_cmd_group[] = {
         "\t-p         - enable profiling (optional)\n"
 #endif
         "\t-s         - swap layers when committed\n"
+        "\t-a         - prefetch image blocks when containers are created "
+            "(optional)\n"
+        "\t-z[level]  - compress files in image layers, zlib level 1-9 "
+            "(optional)\n"
+        "\t-n[node]   - run threads and allocate memory on a NUMA node, "
+            "current node by default (optional)\n"
         "\t-v         - enable verbose mode (optional)\n",
         3,
         cmd_daemon
@@ -71,6 +77,28 @@ cmd_group lcfs_cmd_group[] = {
         2,
         cmd_ioctl
     },
+    {
+        "qos",
+        "Limit I/O of a layer",
+        "<mnt> <id> <iops> <bandwidth>",
+        "\tmnt       - mount point\n"
+        "\tid        - layer name\n"
+        "\tiops      - operations per second, 0 for unlimited\n"
+        "\tbandwidth - MB per second, 0 for unlimited\n",
+        4,
+        cmd_ioctl
+    },
+    {
+        "quota",
+        "Limit space used by a layer",
+        "<mnt> <id> <size> <inodes>",
+        "\tmnt       - mount point\n"
+        "\tid        - layer name\n"
+        "\tsize      - space in MB, 0 for unlimited\n"
+        "\tinodes    - number of inodes, 0 for unlimited\n",
+        4,
+        cmd_ioctl
+    },
     {
         "commit",
         "Commit to disk",
@@ -97,6 +125,64 @@ cmd_group lcfs_cmd_group[] = {
         2,
         cmd_ioctl
     },
+    {
+        "pin",
+        "Pin pages of a layer or a file in cache",
+        "<mnt> <id> [path]",
+        "\tmnt     - mount point\n"
+        "\tid      - layer name\n"
+        "\t[path]  - file in the layer (optional)\n",
+        2,
+        cmd_ioctl
+    },
+    {
+        "unpin",
+        "Unpin pages of a layer or a file",
+        "<mnt> <id> [path]",
+        "\tmnt     - mount point\n"
+        "\tid      - layer name\n"
+        "\t[path]  - file in the layer (optional)\n",
+        2,
+        cmd_ioctl
+    },
+    {
+        "prefetch",
+        "Prefetch image blocks containers read when started",
+        "<mnt> <id>",
+        "\tmnt     - mount point\n"
+        "\tid      - layer name\n",
+        2,
+        cmd_ioctl
+    },
+    {
+        "send",
+        "Write an image layer to a stream file",
+        "<mnt> <id> <file>",
+        "\tmnt     - mount point\n"
+        "\tid      - layer name\n"
+        "\tfile    - stream file\n",
+        3,
+        cmd_ioctl
+    },
+    {
+        "receive",
+        "Populate a new image layer from a stream file",
+        "<mnt> <id> <file>",
+        "\tmnt     - mount point\n"
+        "\tid      - layer name\n"
+        "\tfile    - stream file\n",
+        3,
+        cmd_ioctl
+    },
+    {
+        "pinmem",
+        "Adjust memory limit for pinned pages (default 64MB)",
+        "<mnt> <limit>",
+        "\tmnt     - mount point\n"
+        "\tlimit   - memory limit in MB (default 64MB)\n",
+        2,
+        cmd_ioctl
+    },
     {
         "flush",
         "Release pages not in use",
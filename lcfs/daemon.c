@@ -20,7 +20,8 @@ usage(char *prog) {
 #ifndef __MUSL__
                        " [-p]"
 #endif
-                       " [-f] [-c] [-d] [-m] [-r] [-t] [-s] [-v]\n",
+                       " [-f] [-c] [-d] [-m] [-r] [-t] [-s] [-a] [-z[level]]"
+                       " [-n[node]] [-v]\n",
                        prog);
     lc_syslog(LOG_ERR, "\tdevice        - device or file - image layers"
                        " will be saved here\n"
@@ -37,6 +38,13 @@ usage(char *prog) {
                     "\t-p            - enable profiling (optional)\n"
 #endif
                     "\t-s            - swap layers when committed\n"
+                    "\t-a            - prefetch image blocks when containers"
+                                       " are created (optional)\n"
+                    "\t-z[level]     - compress files in image layers,"
+                                       " zlib level 1-9 (optional)\n"
+                    "\t-n[node]      - run threads and allocate memory on a"
+                                       " NUMA node, current node by default"
+                                       " (optional)\n"
                     "\t-v            - enable verbose mode (optional)\n");
 }
 
@@ -104,7 +112,7 @@ lc_stopSession(struct gfs *gfs, struct fuse_session *se, enum lc_mountId id) {
 static void *
 lc_startThreads(void *data) {
     struct gfs *gfs = (struct gfs *)data;
-    pthread_t flusher, syncer;
+    pthread_t flusher, syncer, reclaimer;
     int err;
 
     /* Start a thread to flush dirty pages */
@@ -115,12 +123,20 @@ lc_startThreads(void *data) {
     err = pthread_create(&syncer, NULL, lc_syncer, gfs);
     assert(err == 0);
 
+    /* Start a thread to remove detached directory trees */
+    err = pthread_create(&reclaimer, NULL, lc_reclaimer, gfs);
+    assert(err == 0);
+
     /* Flush and purge pages in the background */
     lc_cleaner();
 
-    /* Wait for flusher and syncer to exit */
+    /* Wait for flusher, syncer and reclaimer to exit */
     pthread_cond_signal(&gfs->gfs_flusherCond);
     pthread_cond_signal(&gfs->gfs_syncerCond);
+    pthread_mutex_lock(&gfs->gfs_rclock);
+    pthread_cond_signal(&gfs->gfs_reclaimCond);
+    pthread_mutex_unlock(&gfs->gfs_rclock);
+    pthread_join(reclaimer, NULL);
     pthread_join(syncer, NULL);
     pthread_join(flusher, NULL);
     return NULL;
@@ -314,8 +330,9 @@ lc_start(struct gfs *gfs, char *device, enum lc_mountId id) {
 int
 lcfs_main(char *pgm, int argc, char *argv[]) {
     bool daemon = true, format = false, ftypes = false, swap = false;
-    int i, err = -1, waiter[2], fd, count;
-    char *arg[argc + 1], completed;
+    int i, err = -1, waiter[2], fd, count, compress = 0, node = -1;
+    bool prefetch = false;
+    char *arg[argc + 1], completed, *end;
     struct fuse_session *se;
 #ifndef __MUSL__
     bool profiling = false;
@@ -405,6 +422,30 @@ lcfs_main(char *pgm, int argc, char *argv[]) {
 #endif
         } else if (!strcmp(argv[i], "-s")) {
             swap = true;
+        } else if (!strcmp(argv[i], "-a")) {
+            prefetch = true;
+        } else if (!strncmp(argv[i], "-n", 2)) {
+            node = argv[i][2] ? strtol(&argv[i][2], &end, 10) :
+                                LC_NUMA_NODES_MAX;
+            if (argv[i][2] &&
+                (*end || (node < 0) || (node >= LC_NUMA_NODES_MAX))) {
+                lc_syslog(LOG_ERR, "Invalid NUMA node %s\n", &argv[i][2]);
+                usage(pgm);
+                close(fd);
+                closelog();
+                exit(EINVAL);
+            }
+        } else if (!strncmp(argv[i], "-z", 2)) {
+            compress = argv[i][2] ? atoi(&argv[i][2]) : LC_COMPRESS_LEVEL;
+            if ((compress < Z_BEST_SPEED) ||
+                (compress > Z_BEST_COMPRESSION)) {
+                lc_syslog(LOG_ERR, "Invalid compression level %s\n",
+                          &argv[i][2]);
+                usage(pgm);
+                close(fd);
+                closelog();
+                exit(EINVAL);
+            }
         } else if (!strcmp(argv[i], "-v")) {
             lc_verbose = true;
         } else {
@@ -458,10 +499,13 @@ lcfs_main(char *pgm, int argc, char *argv[]) {
         gfs->gfs_waiter = waiter;
     }
     gfs->gfs_fd = fd;
+    gfs->gfs_sfd = lc_deviceOpenSplice(argv[1]);
 #ifndef __MUSL__
     gfs->gfs_profiling = profiling;
 #endif
     gfs->gfs_swapLayersForCommit = swap;
+    gfs->gfs_prefetch = prefetch;
+    gfs->gfs_compress = compress;
 
     /* Setup arguments for fuse mount */
     arg[0] = pgm;
@@ -481,6 +525,24 @@ lcfs_main(char *pgm, int argc, char *argv[]) {
 #endif
                     "suid,dev,subtype=lcfs,fsname=%s", argv[1]);
 
+    /* Bind to a NUMA node if requested, before any thread is created so that
+     * all threads inherit the CPU affinity and the memory policy.
+     */
+    lc_numaInit(gfs);
+    if (node >= 0) {
+        if (node == LC_NUMA_NODES_MAX) {
+            node = lc_numaNode(gfs);
+        }
+        err = lc_numaBind(gfs, node);
+        if (err) {
+            lc_syslog(LOG_ERR, "Failed to bind to NUMA node %d of %d\n",
+                      node, gfs->gfs_nodes);
+            usage(pgm);
+            goto out;
+        }
+        lc_syslog(LOG_INFO, "Bound to NUMA node %d\n", node);
+    }
+
     /* Start fuse sessions for the given mount points */
     err = lc_fuseSession(gfs, arg, count, LC_BASE_MOUNT);
     if (err) {
@@ -539,6 +601,9 @@ out:
     }
     lc_free(NULL, arg[3], LC_SIZEOF_MOUNTARGS, LC_MEMTYPE_GFS);
     close(fd);
+    if (gfs->gfs_sfd != -1) {
+        close(gfs->gfs_sfd);
+    }
     lc_free(NULL, gfs, sizeof(struct gfs), LC_MEMTYPE_GFS);
     lc_displayGlobalMemStats();
     closelog();
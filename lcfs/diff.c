@@ -10,27 +10,53 @@ lc_changeInode(ino_t ino, ino_t lastIno) {
     return (ino > lastIno) ? LC_ADDED : LC_MODIFIED;
 }
 
+/* Find a directory in the change list */
+static inline struct cdir *
+lc_findChangedDir(struct fs *fs, ino_t ino) {
+    struct cdir *cdir = fs->fs_chash[ino % LC_CHANGE_HASH_SIZE];
+
+    while (cdir && (cdir->cd_ino != ino)) {
+        cdir = cdir->cd_hnext;
+    }
+    return cdir;
+}
+
+/* Return the hash list of a file in the change list.  Names are taken from
+ * directory entries, which point to interned names, and thus same names in
+ * any directory have the same address.
+ */
+static inline struct cfile **
+lc_changedFileHash(struct fs *fs, struct cdir *cdir, char *name) {
+    return &fs->fs_fhash[(((uintptr_t)name >> 3) ^ cdir->cd_ino) %
+                         LC_CHANGE_HASH_SIZE];
+}
+
+/* Find a file in a directory in the change list */
+static inline struct cfile *
+lc_findChangedFile(struct fs *fs, struct cdir *cdir, char *name,
+                   uint16_t len) {
+    struct cfile *cfile = *lc_changedFileHash(fs, cdir, name);
+
+    while (cfile && ((cfile->cf_dir != cdir) || (cfile->cf_name != name))) {
+        cfile = cfile->cf_hnext;
+    }
+    assert((cfile == NULL) || (cfile->cf_len == len));
+    return cfile;
+}
+
 /* Add a file to the change list */
 static void
 lc_addFile(struct fs *fs, struct cdir *cdir, ino_t ino, char *name,
            uint16_t len, enum lc_changeType ctype) {
-    struct cfile *cfile = cdir->cd_file, **prev = &cdir->cd_file;
-    bool found = false;
+    struct cfile *cfile, **hash;
 
     assert(cdir->cd_type != LC_REMOVED);
 
     /* Check if the file already in the list */
-    while (cfile) {
-        if ((cfile->cf_len == len) && !strncmp(cfile->cf_name, name, len)) {
-            found = true;
-            break;
-        }
-        prev = &cfile->cf_next;
-        cfile = cfile->cf_next;
-    }
+    cfile = lc_findChangedFile(fs, cdir, name, len);
 
     /* If an entry exists already, return after updating it */
-    if (found) {
+    if (cfile) {
         if ((cfile->cf_type == LC_REMOVED) && (ctype == LC_ADDED)) {
             cfile->cf_type = LC_MODIFIED;
         } else {
@@ -47,7 +73,16 @@ lc_addFile(struct fs *fs, struct cdir *cdir, ino_t ino, char *name,
     cfile->cf_name = name;
     cfile->cf_len = len;
     cfile->cf_next = NULL;
-    *prev = cfile;
+    cfile->cf_dir = cdir;
+    hash = lc_changedFileHash(fs, cdir, name);
+    cfile->cf_hnext = *hash;
+    *hash = cfile;
+    if (cdir->cd_lfile) {
+        cdir->cd_lfile->cf_next = cfile;
+    } else {
+        cdir->cd_file = cfile;
+    }
+    cdir->cd_lfile = cfile;
 }
 
 /* Compare directory entries with parent layer and populate the change list
@@ -248,10 +283,7 @@ lc_addDirectoryTree(struct fs *fs, struct inode *dir, struct cdir *cdir,
      * compare those directories.
      */
     if (pcdir == NULL) {
-        pcdir = fs->fs_changes;
-        while (pcdir && (pcdir->cd_ino != parent)) {
-            pcdir = pcdir->cd_next;
-        }
+        pcdir = lc_findChangedDir(fs, parent);
     }
     if (pcdir->cd_type == LC_MODIFIED) {
         pdir = (dir == fs->fs_rootInode) ? fs->fs_parent->fs_rootInode :
@@ -273,10 +305,14 @@ lc_addDirectoryTree(struct fs *fs, struct inode *dir, struct cdir *cdir,
 static void
 lc_addDirectoryPath(struct fs *fs, ino_t ino, ino_t parent, struct cdir *new,
                     struct cdir *cdir, char *name, uint16_t len) {
-    struct cfile *cfile, **prev;
+    struct cfile *cfile, **prev, *last;
     struct dirent *dirent;
     uint16_t plen;
 
+    /* Add the directory to the hash table */
+    new->cd_hnext = fs->fs_chash[ino % LC_CHANGE_HASH_SIZE];
+    fs->fs_chash[ino % LC_CHANGE_HASH_SIZE] = new;
+
     /* Root directory is added first */
     if (ino == fs->fs_root) {
         assert(fs->fs_changes == NULL);
@@ -289,10 +325,7 @@ lc_addDirectoryPath(struct fs *fs, ino_t ino, ino_t parent, struct cdir *new,
 
         /* Find parent directory entry */
         if (cdir == NULL) {
-            cdir = fs->fs_changes;
-            while (cdir && (cdir->cd_ino != parent)) {
-                cdir = cdir->cd_next;
-            }
+            cdir = lc_findChangedDir(fs, parent);
         }
         assert(cdir->cd_ino == parent);
 
@@ -308,22 +341,30 @@ lc_addDirectoryPath(struct fs *fs, ino_t ino, ino_t parent, struct cdir *new,
         }
 
         /* Check if there is a removed entry for this name */
-        if (cdir->cd_type == LC_MODIFIED) {
-            cfile = cdir->cd_file;
+        cfile = (cdir->cd_type == LC_MODIFIED) ?
+                lc_findChangedFile(fs, cdir, name, len) : NULL;
+        if (cfile) {
+            assert(new->cd_type == LC_ADDED);
+            assert(cfile->cf_type == LC_REMOVED);
+
+            /* Unlink the entry from the hash list and the directory */
+            prev = lc_changedFileHash(fs, cdir, name);
+            while (*prev != cfile) {
+                prev = &(*prev)->cf_hnext;
+            }
+            *prev = cfile->cf_hnext;
             prev = &cdir->cd_file;
-            while (cfile && ((cfile->cf_len != len) ||
-                             strncmp(cfile->cf_name, name, len))) {
-                prev = &cfile->cf_next;
-                cfile = cfile->cf_next;
+            last = NULL;
+            while (*prev != cfile) {
+                last = *prev;
+                prev = &last->cf_next;
             }
-            if (cfile && (cfile->cf_len == len) &&
-                !strncmp(cfile->cf_name, name, len)) {
-                assert(new->cd_type == LC_ADDED);
-                assert(cfile->cf_type == LC_REMOVED);
-                *prev = cfile->cf_next;
-                lc_free(fs, cfile, sizeof(struct cfile), LC_MEMTYPE_CFILE);
-                new->cd_type = LC_MODIFIED;
+            *prev = cfile->cf_next;
+            if (cdir->cd_lfile == cfile) {
+                cdir->cd_lfile = last;
             }
+            lc_free(fs, cfile, sizeof(struct cfile), LC_MEMTYPE_CFILE);
+            new->cd_type = LC_MODIFIED;
         }
 
         /* Prepare complete path and link to the record */
@@ -355,10 +396,7 @@ lc_addDirectory(struct fs *fs, struct inode *dir, char *name, uint16_t len,
 retry:
 
     /* Check if the directory entry exists already */
-    cdir = pcdir ? pcdir : fs->fs_changes;
-    while (cdir && (cdir->cd_ino != ino)) {
-        cdir = cdir->cd_next;
-    }
+    cdir = lc_findChangedDir(fs, ino);
 
     /* Check if an entry is found */
     if (cdir) {
@@ -385,6 +423,7 @@ retry:
     new->cd_ino = ino;
     new->cd_type = ctype;
     new->cd_file = NULL;
+    new->cd_lfile = NULL;
 
     /* Add this directory to the change list */
     lc_addDirectoryPath(fs, ino, parent, new, pcdir, name, len);
@@ -440,10 +479,7 @@ lc_addModifiedInode(struct fs *fs, struct inode *inode, ino_t lastIno) {
         }
 
         /* Find the entry for parent directory */
-        cdir = fs->fs_changes;
-        while (cdir && (cdir->cd_ino != parent)) {
-            cdir = cdir->cd_next;
-        }
+        cdir = lc_findChangedDir(fs, parent);
 
         /* If an entry for the parent doesn't exist, add one */
         if (cdir == NULL) {
@@ -588,15 +624,200 @@ lc_freeChangeList(struct fs *fs) {
     fs->fs_changes = NULL;
 }
 
+/* Add an inode to a scan buffer, growing the buffer if full.  Buffers are
+ * not counted against the layer, as those are allocated by many threads.
+ */
+static void
+lc_scanAdd(struct inode ***inodes, uint64_t *count, uint64_t *size,
+           struct inode *inode) {
+    struct inode **new;
+
+    if (*count == *size) {
+        new = lc_malloc(NULL, (*size ? (*size * 2) : LC_DIFF_SCAN_BUFFER) *
+                              sizeof(struct inode *), LC_MEMTYPE_DIFF);
+        if (*size) {
+            memcpy(new, *inodes, *size * sizeof(struct inode *));
+            lc_free(NULL, *inodes, *size * sizeof(struct inode *),
+                    LC_MEMTYPE_DIFF);
+        }
+        *size = *size ? (*size * 2) : LC_DIFF_SCAN_BUFFER;
+        *inodes = new;
+    }
+    (*inodes)[(*count)++] = inode;
+}
+
+/* Scan a portion of the inode cache of the layer, collecting directories and
+ * other inodes not removed, or resetting LC_INODE_CTRACKED flags.
+ */
+static void *
+lc_scanInodes(void *data) {
+    struct cscan *cscan = (struct cscan *)data;
+    struct fs *fs = cscan->cs_fs;
+    struct inode *inode;
+    uint64_t i;
+
+    for (i = cscan->cs_start; i < cscan->cs_end; i++) {
+        inode = fs->fs_icache[i].ic_head;
+        while (inode) {
+            if (cscan->cs_reset) {
+                inode->i_flags &= ~LC_INODE_CTRACKED;
+            } else if (!(inode->i_flags & LC_INODE_REMOVED)) {
+                if (S_ISDIR(inode->i_mode)) {
+                    lc_scanAdd(&cscan->cs_dirs, &cscan->cs_dcount,
+                               &cscan->cs_dsize, inode);
+                } else {
+                    lc_scanAdd(&cscan->cs_files, &cscan->cs_fcount,
+                               &cscan->cs_fsize, inode);
+                }
+            }
+            inode = inode->i_cnext;
+        }
+    }
+    return NULL;
+}
+
+/* Scan the inode cache of a layer, partitioned across a number of threads */
+static void
+lc_scanInodeCache(struct fs *fs, struct cscan *cscans, int threads,
+                  bool reset) {
+    uint64_t chunk = (fs->fs_icacheSize + threads - 1) / threads;
+    pthread_t tid[LC_DIFF_THREADS_MAX];
+    int i, err;
+
+    for (i = 0; i < threads; i++) {
+        cscans[i].cs_fs = fs;
+        cscans[i].cs_reset = reset;
+        cscans[i].cs_start = i * chunk;
+        cscans[i].cs_end = (i + 1) * chunk;
+        if (cscans[i].cs_end > fs->fs_icacheSize) {
+            cscans[i].cs_end = fs->fs_icacheSize;
+        }
+        if (cscans[i].cs_start > cscans[i].cs_end) {
+            cscans[i].cs_start = cscans[i].cs_end;
+        }
+
+        /* First portion is scanned by this thread */
+        if (i) {
+            err = pthread_create(&tid[i], NULL, lc_scanInodes, &cscans[i]);
+            assert(err == 0);
+        }
+    }
+    lc_scanInodes(&cscans[0]);
+    for (i = 1; i < threads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+}
+
+/* Return number of threads to scan the inode cache of a layer */
+static int
+lc_diffThreads(struct fs *fs) {
+    long cpus;
+
+    if (fs->fs_icount < LC_DIFF_PARALLEL_MIN) {
+        return 1;
+    }
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 1) {
+        return 1;
+    }
+    return (cpus > LC_DIFF_THREADS_MAX) ? LC_DIFF_THREADS_MAX : cpus;
+}
+
+/* Build the list of changes in a layer relative to its parent layer.  Every
+ * file in a base layer is considered added.
+ */
+void
+lc_buildChangeList(struct fs *fs) {
+    struct cscan cscans[LC_DIFF_THREADS_MAX];
+    int i, threads = lc_diffThreads(fs);
+    struct fs *pfs = fs->fs_parent;
+    struct timeval start, now;
+    struct inode *inode;
+    ino_t lastIno = 0;
+    uint64_t j;
+
+    assert(fs->fs_changes == NULL);
+    gettimeofday(&start, NULL);
+    fs->fs_chash = lc_malloc(fs, LC_CHANGE_HASH_SIZE * sizeof(struct cdir *),
+                             LC_MEMTYPE_DIFF);
+    memset(fs->fs_chash, 0, LC_CHANGE_HASH_SIZE * sizeof(struct cdir *));
+    fs->fs_fhash = lc_malloc(fs, LC_CHANGE_HASH_SIZE * sizeof(struct cfile *),
+                             LC_MEMTYPE_DIFF);
+    memset(fs->fs_fhash, 0, LC_CHANGE_HASH_SIZE * sizeof(struct cfile *));
+
+    /* Find inodes present in the layer, with the inode cache partitioned
+     * across threads.  Results are merged in the order of the inode cache.
+     */
+    memset(cscans, 0, sizeof(cscans));
+    lc_scanInodeCache(fs, cscans, threads, false);
+    if (pfs) {
+        lc_lock(pfs, false);
+        lastIno = pfs->fs_super->sb_lastInode;
+    }
+
+    /* Add the root inode to the change list first */
+    lc_addDirectory(fs, fs->fs_rootInode, NULL, 0, lastIno,
+                    pfs ? LC_MODIFIED : LC_ADDED);
+
+    /* Add directories of this layer, skipping those already processed */
+    for (i = 0; i < threads; i++) {
+        for (j = 0; j < cscans[i].cs_dcount; j++) {
+            inode = cscans[i].cs_dirs[j];
+            if (!(inode->i_flags & LC_INODE_CTRACKED)) {
+                lc_addDirectory(fs, inode, NULL, 0, lastIno,
+                                lc_changeInode(inode->i_ino, lastIno));
+            }
+        }
+    }
+
+    /* Add modified files of this layer, skipping those already processed */
+    for (i = 0; i < threads; i++) {
+        for (j = 0; j < cscans[i].cs_fcount; j++) {
+            inode = cscans[i].cs_files[j];
+            if (!(inode->i_flags & LC_INODE_CTRACKED)) {
+                lc_addModifiedInode(fs, inode, lastIno);
+            }
+        }
+    }
+    if (pfs) {
+        lc_unlock(pfs);
+    }
+
+    /* Release scan buffers and hash tables */
+    for (i = 0; i < threads; i++) {
+        if (cscans[i].cs_dsize) {
+            lc_free(NULL, cscans[i].cs_dirs,
+                    cscans[i].cs_dsize * sizeof(struct inode *),
+                    LC_MEMTYPE_DIFF);
+        }
+        if (cscans[i].cs_fsize) {
+            lc_free(NULL, cscans[i].cs_files,
+                    cscans[i].cs_fsize * sizeof(struct inode *),
+                    LC_MEMTYPE_DIFF);
+        }
+    }
+    lc_free(fs, fs->fs_chash, LC_CHANGE_HASH_SIZE * sizeof(struct cdir *),
+            LC_MEMTYPE_DIFF);
+    fs->fs_chash = NULL;
+    lc_free(fs, fs->fs_fhash, LC_CHANGE_HASH_SIZE * sizeof(struct cfile *),
+            LC_MEMTYPE_DIFF);
+    fs->fs_fhash = NULL;
+
+    /* Reset LC_INODE_CTRACKED flags on inodes */
+    lc_scanInodeCache(fs, cscans, threads, true);
+    gettimeofday(&now, NULL);
+    lc_printf("Change list of layer %d built in %ld usec using %d threads\n",
+              fs->fs_gindex, ((now.tv_sec - start.tv_sec) * 1000000) +
+                             (now.tv_usec - start.tv_usec), threads);
+}
+
 /* Produce diff between a layer and its parent layer */
 int
 lc_layerDiff(fuse_req_t req, const char *name, size_t size) {
     struct gfs *gfs = getfs();
     struct fs *fs, *rfs;
-    struct inode *inode;
-    ino_t ino, lastIno;
     char *data;
-    int i;
+    ino_t ino;
 
     /* Respond to plugin checking whether swapping of layers enabled or not */
     if (!strcmp(name, ".")) {
@@ -642,53 +863,9 @@ lc_layerDiff(fuse_req_t req, const char *name, size_t size) {
         return 0;
     }
     lc_printf("Starting diff on layer %d\n", fs->fs_gindex);
-
-    lc_lock(fs->fs_parent, false);
-    lastIno = fs->fs_parent->fs_super->sb_lastInode;
-
-    /* Add the root inode to the change list first */
-    lc_addDirectory(fs, fs->fs_rootInode, NULL, 0, lastIno, LC_MODIFIED);
-
-    /* Traverse inode cache, looking for modified directories in this layer */
-    for (i = 0; i < fs->fs_icacheSize; i++) {
-        inode = fs->fs_icache[i].ic_head;
-        while (inode) {
-
-            /* Skip removed directories and those already processed */
-            if (S_ISDIR(inode->i_mode) &&
-                !(inode->i_flags & (LC_INODE_REMOVED | LC_INODE_CTRACKED))) {
-                lc_addDirectory(fs, inode, NULL, 0, lastIno,
-                                lc_changeInode(inode->i_ino, lastIno));
-            }
-            inode = inode->i_cnext;
-        }
-    }
-
-    /* Traverse inode cache, looking for modified files in this layer */
-    for (i = 0; i < fs->fs_icacheSize; i++) {
-        inode = fs->fs_icache[i].ic_head;
-        while (inode) {
-
-            /* Skip removed files and those already processed */
-            if (!(inode->i_flags & (LC_INODE_REMOVED | LC_INODE_CTRACKED)) &&
-                !S_ISDIR(inode->i_mode)) {
-                lc_addModifiedInode(fs, inode, lastIno);
-            }
-            inode = inode->i_cnext;
-        }
-    }
-    lc_unlock(fs->fs_parent);
+    lc_buildChangeList(fs);
     lc_replyDiff(req, fs);
 
-    /* Reset LC_INODE_CTRACKED flags on inodes */
-    for (i = 0; i < fs->fs_icacheSize; i++) {
-        inode = fs->fs_icache[i].ic_head;
-        while (inode) {
-            inode->i_flags &= ~LC_INODE_CTRACKED;
-            inode = inode->i_cnext;
-        }
-    }
-
 out:
     lc_unlock(fs);
     lc_unlock(rfs);
@@ -26,6 +26,12 @@ struct cfile {
     /* Next file in the list */
     struct cfile *cf_next;
 
+    /* Next file in the hash list used while building the change list */
+    struct cfile *cf_hnext;
+
+    /* Directory the file is in */
+    struct cdir *cf_dir;
+
     /* Length of name */
     uint16_t cf_len:14;
 
@@ -51,8 +57,102 @@ struct cdir {
     /* Next directory in the list */
     struct cdir *cd_next;
 
+    /* Next directory in the hash list used while building the change list */
+    struct cdir *cd_hnext;
+
     /* A linked list of files added/modified/removed */
     struct cfile *cd_file;
+
+    /* Last file in cd_file list */
+    struct cfile *cd_lfile;
+} __attribute__((packed));
+
+/* Number of hash lists for looking up directories and files while building
+ * the change list.
+ */
+#define LC_CHANGE_HASH_SIZE     65536
+
+/* Minimum number of inodes in a layer for scanning the inode cache with many
+ * threads.
+ */
+#define LC_DIFF_PARALLEL_MIN    65536
+
+/* Maximum number of threads scanning the inode cache of a layer */
+#define LC_DIFF_THREADS_MAX     16
+
+/* Initial number of inodes a scan buffer could hold */
+#define LC_DIFF_SCAN_BUFFER     1024
+
+/* Inodes found by a thread scanning a portion of the inode cache */
+struct cscan {
+
+    /* Layer being scanned */
+    struct fs *cs_fs;
+
+    /* Directories found */
+    struct inode **cs_dirs;
+
+    /* Other inodes found */
+    struct inode **cs_files;
+
+    /* First hash list to scan */
+    uint64_t cs_start;
+
+    /* Hash list after the last one to scan */
+    uint64_t cs_end;
+
+    /* Number of directories in cs_dirs */
+    uint64_t cs_dcount;
+
+    /* Size of cs_dirs */
+    uint64_t cs_dsize;
+
+    /* Number of inodes in cs_files */
+    uint64_t cs_fcount;
+
+    /* Size of cs_files */
+    uint64_t cs_fsize;
+
+    /* Set to reset flags on inodes instead of collecting those */
+    bool cs_reset;
+};
+
+/* A file with many links written to a layer stream */
+struct slink {
+
+    /* Inode number of the file */
+    ino_t sl_ino;
+
+    /* Path the file was written with */
+    char *sl_path;
+
+    /* Next file in the list */
+    struct slink *sl_next;
+
+    /* Length of path */
+    uint16_t sl_len;
 } __attribute__((packed));
 
+/* State of a layer being written to or read from a stream */
+struct sstream {
+
+    /* Layer being sent or received */
+    struct fs *ss_fs;
+
+    /* Stream file */
+    FILE *ss_fp;
+
+    /* Files with many links written to the stream */
+    struct slink *ss_links;
+
+    /* Number of records in the stream */
+    uint64_t ss_records;
+
+    /* Number of data blocks in the stream */
+    uint64_t ss_blocks;
+
+    /* First error encountered */
+    int ss_err;
+};
+
 #endif
@@ -12,6 +12,125 @@ lc_dirhash(const char *name, size_t size) {
     return (hash + size) % LC_DIRCACHE_SIZE;
 }
 
+/* Calculate hash value of the whole name, cached with interned names */
+static inline uint32_t
+lc_nameHash(const char *name, size_t size) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Initialize the table of names shared by directory entries of all layers */
+void
+lc_nameInit(struct gfs *gfs) {
+    int i;
+
+    gfs->gfs_names = lc_malloc(NULL, LC_NCACHE_SIZE * sizeof(struct lname *),
+                               LC_MEMTYPE_GFS);
+    memset(gfs->gfs_names, 0, LC_NCACHE_SIZE * sizeof(struct lname *));
+    gfs->gfs_nlocks = lc_malloc(NULL,
+                                LC_NCLOCK_COUNT * sizeof(pthread_mutex_t),
+                                LC_MEMTYPE_GFS);
+    for (i = 0; i < LC_NCLOCK_COUNT; i++) {
+        pthread_mutex_init(&gfs->gfs_nlocks[i], NULL);
+    }
+}
+
+/* Free the name table, all names should have been released by now */
+void
+lc_nameDeinit(struct gfs *gfs) {
+#ifdef LC_MUTEX_DESTROY
+    int i;
+
+    for (i = 0; i < LC_NCLOCK_COUNT; i++) {
+        pthread_mutex_destroy(&gfs->gfs_nlocks[i]);
+    }
+#endif
+    assert(gfs->gfs_ncount == 0);
+    lc_free(NULL, gfs->gfs_names, LC_NCACHE_SIZE * sizeof(struct lname *),
+            LC_MEMTYPE_GFS);
+    lc_free(NULL, gfs->gfs_nlocks, LC_NCLOCK_COUNT * sizeof(pthread_mutex_t),
+            LC_MEMTYPE_GFS);
+}
+
+/* Return the lock protecting the hash list of a name */
+static inline pthread_mutex_t *
+lc_nameLock(struct gfs *gfs, uint32_t hash) {
+    return &gfs->gfs_nlocks[(hash % LC_NCACHE_SIZE) % LC_NCLOCK_COUNT];
+}
+
+/* Take a reference on the interned copy of a name, adding the name to the
+ * table if not present already.
+ */
+static char *
+lc_nameGet(struct gfs *gfs, const char *name, int size, uint32_t hash) {
+    pthread_mutex_t *lock = lc_nameLock(gfs, hash);
+    struct lname *lname, **head;
+
+    pthread_mutex_lock(lock);
+    head = &gfs->gfs_names[hash % LC_NCACHE_SIZE];
+    lname = *head;
+    while (lname) {
+        if ((lname->n_hash == hash) && (lname->n_size == size) &&
+            (memcmp(lname->n_name, name, size) == 0)) {
+            __sync_add_and_fetch(&lname->n_refs, 1);
+            pthread_mutex_unlock(lock);
+            __sync_add_and_fetch(&gfs->gfs_nshared, 1);
+            return lname->n_name;
+        }
+        lname = lname->n_next;
+    }
+    lname = lc_malloc(NULL, sizeof(struct lname) + size + 1, LC_MEMTYPE_NAME);
+    lname->n_refs = 1;
+    lname->n_hash = hash;
+    lname->n_size = size;
+    memcpy(lname->n_name, name, size);
+    lname->n_name[size] = 0;
+    lname->n_next = *head;
+    *head = lname;
+    pthread_mutex_unlock(lock);
+    __sync_add_and_fetch(&gfs->gfs_ncount, 1);
+    return lname->n_name;
+}
+
+/* Release a reference on an interned name and free that if not used by any
+ * other directory entry.
+ */
+static void
+lc_namePut(struct gfs *gfs, char *name) {
+    struct lname *lname = (struct lname *)(name - sizeof(struct lname));
+    pthread_mutex_t *lock = lc_nameLock(gfs, lname->n_hash);
+    struct lname **prev;
+
+    pthread_mutex_lock(lock);
+    if (__sync_sub_and_fetch(&lname->n_refs, 1)) {
+        pthread_mutex_unlock(lock);
+        return;
+    }
+    prev = &gfs->gfs_names[lname->n_hash % LC_NCACHE_SIZE];
+    while (*prev != lname) {
+        prev = &(*prev)->n_next;
+    }
+    *prev = lname->n_next;
+    pthread_mutex_unlock(lock);
+    __sync_sub_and_fetch(&gfs->gfs_ncount, 1);
+    lc_free(NULL, lname, sizeof(struct lname) + lname->n_size + 1,
+            LC_MEMTYPE_NAME);
+}
+
+/* Check if a directory entry is for the specified name */
+static inline bool
+lc_dirNameMatch(struct dirent *dirent, const char *name, int len,
+                uint32_t hash) {
+    return (len == dirent->di_size) &&
+           (lc_direntName(dirent)->n_hash == hash) &&
+           (memcmp(name, dirent->di_name, len) == 0);
+}
+
 /* Allocate hash table for an inode */
 void
 lc_dirConvertHashed(struct fs *fs, struct inode *dir) {
@@ -19,9 +138,8 @@ lc_dirConvertHashed(struct fs *fs, struct inode *dir) {
     uint32_t hash;
 
     assert(S_ISDIR(dir->i_mode));
-    dcache = lc_malloc(fs, LC_DIRCACHE_SIZE * sizeof(struct dirent *),
-                       LC_MEMTYPE_DCACHE);
-    memset(dcache, 0, LC_DIRCACHE_SIZE * sizeof(struct dirent *));
+    dcache = lc_malloc(fs, LC_DIRCACHE_BYTES, LC_MEMTYPE_DCACHE);
+    memset(dcache, 0, LC_DIRCACHE_BYTES);
     while (dirent) {
         next = dirent->di_next;
         hash = lc_dirhash(dirent->di_name, dirent->di_size);
@@ -37,6 +155,62 @@ lc_dirConvertHashed(struct fs *fs, struct inode *dir) {
     //lc_printf("Converted to hashed directory %ld\n", dir->i_ino);
 }
 
+/* Return the bitmap of hash lists shared with parent directory */
+static inline uint8_t *
+lc_dirSharedMap(struct inode *dir) {
+    return (uint8_t *)&dir->i_hdirent[LC_DIRCACHE_SIZE];
+}
+
+/* Check if a hash list is shared with parent directory */
+static inline bool
+lc_dirListShared(struct inode *dir, uint32_t hash) {
+    return (dir->i_flags & LC_INODE_DCOW) &&
+           (lc_dirSharedMap(dir)[hash / 8] & (1 << (hash % 8)));
+}
+
+/* Copy a list of directory entries.  Names are shared with the original
+ * entries.
+ */
+static struct dirent *
+lc_dirCopyList(struct fs *fs, struct dirent *dirent, uint64_t *count) {
+    struct dirent *new, *head = NULL, **prev = &head;
+    uint64_t copied = 0;
+
+    while (dirent) {
+        new = lc_malloc(fs, sizeof(struct dirent), LC_MEMTYPE_DIRENT);
+        new->di_ino = dirent->di_ino;
+        new->di_name = dirent->di_name;
+        __sync_add_and_fetch(&lc_direntName(dirent)->n_refs, 1);
+        new->di_size = dirent->di_size;
+        new->di_mode = dirent->di_mode;
+        new->di_index = dirent->di_index;
+        new->di_next = NULL;
+        *prev = new;
+        prev = &new->di_next;
+        dirent = dirent->di_next;
+        copied++;
+    }
+    if (copied) {
+        __sync_add_and_fetch(&fs->fs_gfs->gfs_nshared, copied);
+        *count += copied;
+    }
+    return head;
+}
+
+/* Make a private copy of a hash list shared with parent directory before
+ * modifying that.
+ */
+static void
+lc_dirUnshare(struct inode *dir, uint32_t hash) {
+    uint64_t count = 0;
+
+    if (lc_dirListShared(dir, hash)) {
+        dir->i_hdirent[hash] = lc_dirCopyList(dir->i_fs, dir->i_hdirent[hash],
+                                              &count);
+        lc_dirSharedMap(dir)[hash / 8] &= ~(1 << (hash % 8));
+    }
+}
+
 /* Get the head of the directory list in which the name could exist */
 static inline struct dirent *
 lc_dirGetDirent(struct inode *dir, const char *name, int len,
@@ -69,13 +243,14 @@ ino_t
 lc_dirLookup(struct fs *fs, struct inode *dir, const char *name) {
     struct dirent *dirent;
     int len = strlen(name);
+    uint32_t hash;
     ino_t dino;
 
     assert(S_ISDIR(dir->i_mode));
     dirent = lc_dirGetDirent(dir, name, len, NULL, NULL);
+    hash = dirent ? lc_nameHash(name, len) : 0;
     while (dirent != NULL) {
-        if ((len == dirent->di_size) &&
-            (strcmp(name, dirent->di_name) == 0)) {
+        if (lc_dirNameMatch(dirent, name, len, hash)) {
             dino = dirent->di_ino;
             return dino;
         }
@@ -103,16 +278,15 @@ lc_dirAdd(struct inode *dir, ino_t ino, mode_t mode, const char *name,
         !(dir->i_flags & LC_INODE_DHASHED)) {
         lc_dirConvertHashed(fs, dir);
     }
-    dirent = lc_malloc(fs, sizeof(struct dirent) + nsize + 1,
-                       LC_MEMTYPE_DIRENT);
+    dirent = lc_malloc(fs, sizeof(struct dirent), LC_MEMTYPE_DIRENT);
     dirent->di_ino = ino;
-    dirent->di_name = ((char *)dirent) + sizeof(struct dirent);
-    memcpy(dirent->di_name, name, nsize);
-    dirent->di_name[nsize] = 0;
+    dirent->di_name = lc_nameGet(fs->fs_gfs, name, nsize,
+                                 lc_nameHash(name, nsize));
     dirent->di_size = nsize;
     dirent->di_mode = mode & S_IFMT;
     if (dir->i_flags & LC_INODE_DHASHED) {
         hash = lc_dirhash(name, nsize);
+        lc_dirUnshare(dir, hash);
         dirent->di_next = dir->i_hdirent[hash];
         dir->i_hdirent[hash] = dirent;
     } else {
@@ -123,75 +297,60 @@ lc_dirAdd(struct inode *dir, ino_t ino, mode_t mode, const char *name,
     dir->i_size++;
 }
 
-/* Copy directory entries from one directory to another */
+/* Copy directory entries from one directory to another.  Hashed directories
+ * keep sharing hash lists with the parent directory, and a list is copied
+ * only when it is modified.
+ */
 void
 lc_dirCopy(struct inode *dir) {
-    bool hashed = (dir->i_flags & LC_INODE_DHASHED);
-    struct dirent *dirent, *new, **prev, **dcache;
+    struct dirent **dcache;
     struct fs *fs = dir->i_fs;
     uint64_t count = 0;
-    uint32_t i, max;
-    size_t nsize;
 
     assert(dir->i_flags & LC_INODE_SHARED);
     assert(S_ISDIR(dir->i_mode));
     assert(dir->i_nlink >= 2);
-    if (hashed) {
+    if (dir->i_flags & LC_INODE_DHASHED) {
 
         /* Parent is using hashed lists, allocate hash table */
         dcache = dir->i_hdirent;
         dir->i_hdirent = NULL;
         lc_dirConvertHashed(fs, dir);
-        max = LC_DIRCACHE_SIZE;
-        dirent = NULL;
+        memcpy(dir->i_hdirent, dcache,
+               LC_DIRCACHE_SIZE * sizeof(struct dirent *));
+        memset(lc_dirSharedMap(dir), 0xff, LC_DIRCACHE_SIZE / 8);
+        dir->i_flags |= LC_INODE_DCOW;
     } else {
-        dirent = dir->i_dirent;
-        dir->i_dirent = NULL;
-        max = 1;
-        dcache = NULL;
+        dir->i_dirent = lc_dirCopyList(fs, dir->i_dirent, &count);
+        assert(dir->i_size == count);
     }
     dir->i_flags &= ~LC_INODE_SHARED;
-    for (i = 0; i < max; i++) {
-        if (hashed) {
-            dirent = dcache[i];
+    lc_markInodeDirty(dir, LC_INODE_DIRDIRTY);
+}
 
-            /* If all entries processed, stop */
-            if (count == dir->i_size) {
-                break;
-            }
-            prev = &dir->i_hdirent[i];
-        } else {
-            prev = &dir->i_dirent;
-        }
+/* Copy all directory entries still shared with the parent directory, before
+ * the parent layer could go away.
+ */
+void
+lc_dirCopyShared(struct inode *dir) {
+    uint32_t i;
 
-        /* Copy every entry in the list */
-        while (dirent) {
-            nsize = dirent->di_size;
-            new = lc_malloc(fs, sizeof(struct dirent) + nsize + 1,
-                            LC_MEMTYPE_DIRENT);
-            new->di_ino = dirent->di_ino;
-            new->di_name = ((char *)new) + sizeof(struct dirent);
-            memcpy(new->di_name, dirent->di_name, nsize);
-            new->di_name[nsize] = 0;
-            new->di_size = nsize;
-            new->di_mode = dirent->di_mode;
-            new->di_index = dirent->di_index;
-            new->di_next = NULL;
-            *prev = new;
-            prev = &new->di_next;
-            dirent = dirent->di_next;
-            count++;
+    if (dir->i_flags & LC_INODE_SHARED) {
+        lc_dirCopy(dir);
+    }
+    if (dir->i_flags & LC_INODE_DCOW) {
+        for (i = 0; i < LC_DIRCACHE_SIZE; i++) {
+            lc_dirUnshare(dir, i);
         }
+        dir->i_flags &= ~LC_INODE_DCOW;
     }
-    assert(dir->i_size == count);
-    lc_markInodeDirty(dir, LC_INODE_DIRDIRTY);
 }
 
 /* Free a dirent structure */
 static inline void
 lc_freeDirent(struct fs *fs, struct dirent *dirent) {
-    lc_free(fs, dirent, sizeof(struct dirent) + dirent->di_size + 1,
-            LC_MEMTYPE_DIRENT);
+    lc_namePut(fs->fs_gfs, dirent->di_name);
+    lc_free(fs, dirent, sizeof(struct dirent), LC_MEMTYPE_DIRENT);
 }
 
 /* Remove a directory entry */
@@ -199,15 +358,18 @@ void
 lc_dirRemove(struct inode *dir, const char *name) {
     struct dirent *dirent, **prev;
     int len = strlen(name);
+    uint32_t hash = lc_nameHash(name, len);
 
     assert(S_ISDIR(dir->i_mode));
     assert(!(dir->i_flags & LC_INODE_SHARED));
+    if (dir->i_flags & LC_INODE_DCOW) {
+        lc_dirUnshare(dir, lc_dirhash(name, len));
+    }
     dirent = lc_dirGetDirent(dir, name, len, &prev, NULL);
 
     /* Search the specified name and remove it if found */
     while (dirent != NULL) {
-        if ((len == dirent->di_size) &&
-            (strcmp(name, dirent->di_name) == 0)) {
+        if (lc_dirNameMatch(dirent, name, len, hash)) {
             *prev = dirent->di_next;
             dir->i_size--;
             lc_freeDirent(dir->i_fs, dirent);
@@ -223,21 +385,25 @@ lc_dirRemove(struct inode *dir, const char *name) {
 void
 lc_dirRename(struct inode *dir, ino_t ino,
               const char *name, const char *newname) {
-    struct dirent *dirent, *new, **prev;
     bool hashed = (dir->i_flags & LC_INODE_DHASHED);
-    uint32_t hash, newhash;
+    uint32_t hash = 0, newhash, nhash;
+    struct dirent *dirent, **prev;
     int len = strlen(name);
-    struct fs *fs;
+    char *oldname;
 
     assert(S_ISDIR(dir->i_mode));
     assert(!(dir->i_flags & LC_INODE_SHARED));
+    if (dir->i_flags & LC_INODE_DCOW) {
+        lc_dirUnshare(dir, lc_dirhash(name, len));
+        lc_dirUnshare(dir, lc_dirhash(newname, strlen(newname)));
+    }
     dirent = lc_dirGetDirent(dir, name, len, &prev, &hash);
+    nhash = lc_nameHash(name, len);
 
     /* Search for entry with old name and replace that with new name */
     while (dirent != NULL) {
-        if ((dirent->di_ino == ino) && (len == dirent->di_size) &&
-            (strcmp(name, dirent->di_name) == 0)) {
-            fs = dir->i_fs;
+        if ((dirent->di_ino == ino) &&
+            lc_dirNameMatch(dirent, name, len, nhash)) {
             len = strlen(newname);
             if (hashed) {
 
@@ -255,23 +421,12 @@ lc_dirRename(struct inode *dir, ino_t ino,
                 }
             }
 
-            /* Existing name can be used if size is not growing */
-            if (len > dirent->di_size) {
-                new = lc_malloc(fs, sizeof(struct dirent) + len + 1,
-                                LC_MEMTYPE_DIRENT);
-                memcpy(new, dirent, sizeof(struct dirent));
-                lc_freeDirent(fs, dirent);
-                dirent = new;
-                *prev = dirent;
-                dirent->di_name = ((char *)dirent) + sizeof(struct dirent);
-            } else if (dirent->di_size > len) {
-
-                /* Adjust memory stats if name size changed */
-                lc_memUpdateTotal(fs, dirent->di_size - len);
-            }
-            memcpy(dirent->di_name, newname, len);
-            dirent->di_name[len] = 0;
+            /* Switch the entry over to the interned new name */
+            oldname = dirent->di_name;
+            dirent->di_name = lc_nameGet(dir->i_fs->fs_gfs, newname, len,
+                                         lc_nameHash(newname, len));
             dirent->di_size = len;
+            lc_namePut(dir->i_fs->fs_gfs, oldname);
             return;
         }
         prev = &dirent->di_next;
@@ -340,7 +495,7 @@ lc_dirFlushBlocks(struct gfs *gfs, struct fs *fs,
     uint64_t block, count = pcount;
     struct dblock *dblock;
 
-    block = lc_blockAllocExact(fs, pcount, true, true);
+    block = lc_metaAlloc(fs, pcount);
 
     /* Link all directory blocks */
     while (page) {
@@ -355,7 +510,7 @@ lc_dirFlushBlocks(struct gfs *gfs, struct fs *fs,
         page = page->p_dnext;
     }
     assert(count == 0);
-    lc_addPageForWriteBack(gfs, fs, fpage, tpage, pcount);
+    lc_metaWriteBack(gfs, fs, fpage, tpage, pcount);
     return block;
 }
 
@@ -447,10 +602,9 @@ lc_dirFlush(struct gfs *gfs, struct fs *fs, struct inode *dir) {
 /* Free directory hash table */
 void
 lc_dirFreeHash(struct fs *fs, struct inode *dir) {
-    lc_free(fs, dir->i_hdirent, LC_DIRCACHE_SIZE * sizeof(struct dirent *),
-            LC_MEMTYPE_DCACHE);
+    lc_free(fs, dir->i_hdirent, LC_DIRCACHE_BYTES, LC_MEMTYPE_DCACHE);
     dir->i_hdirent = NULL;
-    dir->i_flags &= ~LC_INODE_DHASHED;
+    dir->i_flags &= ~(LC_INODE_DHASHED | LC_INODE_DCOW);
 }
 
 /* Free directory entries */
@@ -473,6 +627,14 @@ lc_dirFree(struct inode *dir) {
     for (i = 0; i < max; i++) {
         dirent = hashed ? dir->i_hdirent[i] : dir->i_dirent;
 
+        /* Lists shared with parent are not freed */
+        if (hashed && lc_dirListShared(dir, i)) {
+            while (dirent != NULL) {
+                dirent = dirent->di_next;
+                count++;
+            }
+        }
+
         /* Free all entries in the list */
         while (dirent != NULL) {
             tmp = dirent;
@@ -499,20 +661,25 @@ lc_removeTree(struct fs *fs, struct inode *dir) {
     bool hashed = (dir->i_flags & LC_INODE_DHASHED);
     struct gfs *gfs = fs->fs_gfs;
     struct dirent *dirent;
+    struct inode *inode;
+    bool rmdir, shared;
     int i, max;
-    bool rmdir;
 
     assert(!(dir->i_flags & LC_INODE_SHARED));
     max = hashed ? LC_DIRCACHE_SIZE : 1;
     for (i = 0; (i < max) && dir->i_size; i++) {
+        shared = hashed && lc_dirListShared(dir, i);
         dirent = hashed ? dir->i_hdirent[i] : dir->i_dirent;
         while (dirent != NULL) {
             rmdir = S_ISDIR(dirent->di_mode);
             lc_removeInode(fs, dir, dirent->di_ino, rmdir, NULL);
 
-            /* Invalidate kernel page cache */
+            /* Invalidate kernel page cache if the file was ever opened */
             if (S_ISREG(dirent->di_mode)) {
-                lc_invalInodePages(gfs, dirent->di_ino);
+                inode = lc_lookupInodeCache(fs, dirent->di_ino, -1);
+                if (inode && (inode->i_flags & LC_INODE_KCACHED)) {
+                    lc_invalInodePages(gfs, dirent->di_ino);
+                }
             }
             if (rmdir) {
                 assert(dir->i_nlink > 2);
@@ -526,7 +693,11 @@ lc_removeTree(struct fs *fs, struct inode *dir) {
                 dir->i_dirent = dirent->di_next;
             }
             dir->i_size--;
-            lc_freeDirent(fs, dirent);
+
+            /* Entries shared with parent are just unlinked */
+            if (!shared) {
+                lc_freeDirent(fs, dirent);
+            }
             dirent = hashed ? dir->i_hdirent[i] : dir->i_dirent;
         }
     }
@@ -546,6 +717,216 @@ lc_emptyDirectory(struct fs *fs, ino_t ino) {
     lc_inodeUnlock(dir);
 }
 
+/* Move a directory to the reclaim directory, for removing it along with
+ * everything under it in the background.
+ */
+void
+lc_reclaimMove(struct inode *rdir, struct inode *pdir, struct inode *dir,
+               const char *name) {
+    char rname[32];
+    int len;
+
+    assert(S_ISDIR(dir->i_mode));
+    assert(dir->i_parent == pdir->i_ino);
+
+    /* Name the entry after the inode number, which is unique */
+    len = snprintf(rname, sizeof(rname), "%ld", dir->i_ino);
+    lc_dirAdd(rdir, dir->i_ino, dir->i_mode, rname, len);
+    assert(rdir->i_nlink >= 2);
+    rdir->i_nlink++;
+    lc_dirRemove(pdir, name);
+    assert(pdir->i_nlink > 2);
+    pdir->i_nlink--;
+    lc_updateInodeTimes(pdir, true, true);
+    dir->i_parent = rdir->i_ino;
+    lc_markInodeDirty(rdir, LC_INODE_DIRDIRTY);
+    lc_markInodeDirty(pdir, LC_INODE_DIRDIRTY);
+    lc_markInodeDirty(dir, 0);
+}
+
+/* Remove an entry from a directory pending reclaim.  If the entry cannot be
+ * removed, drop the name anyway so that the reclaimer keeps making progress.
+ */
+static void
+lc_reclaimRemove(struct fs *fs, struct inode *dir, const char *name,
+                 bool rmdir) {
+    int err;
+
+    err = lc_dirRemoveName(fs, dir, name, rmdir, NULL, false);
+    if (err) {
+        lc_reportError(__func__, __LINE__, dir->i_ino, err);
+        lc_dirRemove(dir, name);
+        if (rmdir) {
+            assert(dir->i_nlink > 2);
+            dir->i_nlink--;
+        }
+        lc_markInodeDirty(dir, LC_INODE_DIRDIRTY);
+    }
+}
+
+/* Remove a batch of entries from a directory pending reclaim.  Directories
+ * which are not empty are moved to the reclaim directory instead of being
+ * processed recursively, so that the work done while holding locks is
+ * bounded.  Return true if there may be more work left.
+ */
+static bool
+lc_reclaimBatch(struct gfs *gfs, struct fs *fs) {
+    char name[LC_FILENAME_MAX + 1], rname[LC_FILENAME_MAX + 1];
+    struct inode *rdir, *dir, *inode;
+    struct dirent *dirent = NULL;
+    uint64_t count = 0;
+    bool hashed, empty;
+    int i, max;
+    mode_t mode;
+    ino_t ino;
+
+    rdir = lc_getInode(fs, gfs->gfs_reclaimRoot, NULL, true, true);
+    if (rdir == NULL) {
+        return false;
+    }
+
+    /* Pick a directory pending reclaim */
+    hashed = (rdir->i_flags & LC_INODE_DHASHED);
+    max = hashed ? LC_DIRCACHE_SIZE : 1;
+    for (i = 0; (i < max) && rdir->i_size && (dirent == NULL); i++) {
+        dirent = hashed ? rdir->i_hdirent[i] : rdir->i_dirent;
+    }
+    if (dirent == NULL) {
+        lc_inodeUnlock(rdir);
+        return false;
+    }
+    memcpy(rname, dirent->di_name, dirent->di_size + 1);
+    ino = dirent->di_ino;
+    mode = dirent->di_mode;
+    if (!S_ISDIR(mode)) {
+
+        /* Only directories are moved here, remove anything else */
+        lc_reclaimRemove(fs, rdir, rname, false);
+        lc_inodeUnlock(rdir);
+        __sync_add_and_fetch(&gfs->gfs_reclaimed, 1);
+        return true;
+    }
+    dir = lc_getInode(fs, ino, NULL, true, true);
+    if (dir == NULL) {
+        lc_dirRemove(rdir, rname);
+        assert(rdir->i_nlink > 2);
+        rdir->i_nlink--;
+        lc_markInodeDirty(rdir, LC_INODE_DIRDIRTY);
+        lc_inodeUnlock(rdir);
+        return true;
+    }
+
+    /* Remove entries from the directory */
+    hashed = (dir->i_flags & LC_INODE_DHASHED);
+    max = hashed ? LC_DIRCACHE_SIZE : 1;
+    i = 0;
+    while (dir->i_size && (count < LC_RECLAIM_BATCH) && (i < max)) {
+        dirent = hashed ? dir->i_hdirent[i] : dir->i_dirent;
+        if (dirent == NULL) {
+            i++;
+            continue;
+        }
+        ino = dirent->di_ino;
+        mode = dirent->di_mode;
+        memcpy(name, dirent->di_name, dirent->di_size + 1);
+        count++;
+        if (S_ISDIR(mode)) {
+            inode = lc_getInode(fs, ino, NULL, true, true);
+
+            /* A stale entry is dropped when removing the name below */
+            if (inode) {
+                if (inode->i_size) {
+                    lc_reclaimMove(rdir, dir, inode, name);
+                    lc_inodeUnlock(inode);
+                    continue;
+                }
+                lc_inodeUnlock(inode);
+            }
+        }
+        lc_reclaimRemove(fs, dir, name, S_ISDIR(mode));
+
+        /* Invalidate kernel page cache if the file was ever opened */
+        if (S_ISREG(mode)) {
+            inode = lc_lookupInodeCache(fs, ino, -1);
+            if (inode && (inode->i_flags & LC_INODE_KCACHED)) {
+                lc_invalInodePages(gfs, ino);
+            }
+        }
+    }
+    empty = (dir->i_size == 0);
+    lc_inodeUnlock(dir);
+
+    /* Remove the directory once emptied */
+    if (empty) {
+        lc_reclaimRemove(fs, rdir, rname, true);
+        count++;
+    }
+    lc_inodeUnlock(rdir);
+    __sync_add_and_fetch(&gfs->gfs_reclaimed, count);
+    return true;
+}
+
+/* Remove directory trees moved to the reclaim directory in the background.
+ * The reclaim directory is persistent, so any work left behind when the file
+ * system is unmounted is resumed after the next mount.  Blocks freed from large
+ * files are released as well; a checkpoint adds any of those left behind to
+ * the freed blocks of the layer, leaving cached pages for the reclaimer to
+ * invalidate.
+ */
+void *
+lc_reclaimer(void *data) {
+    struct gfs *gfs = (struct gfs *)data;
+    struct fs *fs = lc_getGlobalFs(gfs);
+    struct timespec interval;
+    struct timeval now;
+    bool more, busy;
+
+    lc_ioSetClass(LC_IO_BACKGROUND);
+    interval.tv_nsec = 0;
+    while (!gfs->gfs_unmounting) {
+        busy = false;
+        do {
+            more = false;
+            if (gfs->gfs_reclaimRoot) {
+                lc_lock(fs, false);
+                more = lc_reclaimBatch(gfs, fs);
+                lc_unlock(fs);
+            }
+
+            /* Release blocks freed from large files */
+            if (lc_reclaimLayerBlocks(gfs, &busy)) {
+                more = true;
+            }
+        } while (more && !gfs->gfs_unmounting);
+
+        /* Retry layers which were locked exclusive after a while */
+        pthread_mutex_lock(&gfs->gfs_rclock);
+        if (busy && !gfs->gfs_reclaimWakeup && !gfs->gfs_unmounting) {
+            gettimeofday(&now, NULL);
+            interval.tv_sec = now.tv_sec + LC_RECLAIM_RETRY;
+            pthread_cond_timedwait(&gfs->gfs_reclaimCond, &gfs->gfs_rclock,
+                                   &interval);
+        }
+        while (!busy && !gfs->gfs_reclaimWakeup && !gfs->gfs_unmounting) {
+            pthread_cond_wait(&gfs->gfs_reclaimCond, &gfs->gfs_rclock);
+        }
+        gfs->gfs_reclaimWakeup = false;
+        pthread_mutex_unlock(&gfs->gfs_rclock);
+    }
+    return NULL;
+}
+
+/* Wake up reclaimer after moving a directory to the reclaim directory or
+ * freeing blocks of a large file.
+ */
+void
+lc_wakeupReclaimer(struct gfs *gfs) {
+    pthread_mutex_lock(&gfs->gfs_rclock);
+    gfs->gfs_reclaimWakeup = true;
+    pthread_cond_signal(&gfs->gfs_reclaimCond);
+    pthread_mutex_unlock(&gfs->gfs_rclock);
+}
+
 /* Lookup an entry in the directory and remove that if present */
 int
 lc_dirRemoveName(struct fs *fs, struct inode *dir,
@@ -554,15 +935,18 @@ lc_dirRemoveName(struct fs *fs, struct inode *dir,
     struct dirent *dirent, **prev;
     struct gfs *gfs = fs->fs_gfs;
     int len = strlen(name), err;
+    uint32_t hash = lc_nameHash(name, len);
     struct fs *rfs;
 
     assert(S_ISDIR(dir->i_mode));
+    if (dir->i_flags & LC_INODE_DCOW) {
+        lc_dirUnshare(dir, lc_dirhash(name, len));
+    }
     dirent = lc_dirGetDirent(dir, name, len, &prev, NULL);
 
     /* Search the list for the specified name */
     while (dirent != NULL) {
-        if ((len == dirent->di_size) &&
-            (strcmp(name, dirent->di_name) == 0)) {
+        if (lc_dirNameMatch(dirent, name, len, hash)) {
             ino = dirent->di_ino;
 
             /* Do not allow removing layer root directory, parent of that and
@@ -570,6 +954,7 @@ lc_dirRemoveName(struct fs *fs, struct inode *dir,
              */
             if (rmdir && !layer && (fs->fs_gindex == 0) &&
                ((ino == gfs->gfs_layerRoot) ||
+                (ino == gfs->gfs_reclaimRoot) ||
                 ((gfs->gfs_layerRootInode != NULL) &&
                  (ino == gfs->gfs_layerRootInode->i_parent)) ||
                 lc_getIndex(fs, parent, ino))) {
@@ -609,6 +994,9 @@ lc_dirRemoveName(struct fs *fs, struct inode *dir,
                     rfs = rfs->fs_zfs;
                     ino = rfs->fs_root;
                     len += strlen("-init");
+                    if (dir->i_flags & LC_INODE_DCOW) {
+                        lc_dirUnshare(dir, lc_dirhash(name, len));
+                    }
                     dirent = lc_dirGetDirent(dir, name, len, &prev, NULL);
                     while (dirent && (dirent->di_ino != ino)) {
                         prev = &dirent->di_next;
@@ -687,6 +1075,13 @@ lc_dirReaddir(fuse_req_t req, struct fs *fs, struct inode *dir,
         while (dirent != NULL) {
             ino = dirent->di_ino;
             assert(ino > LC_ROOT_INODE);
+
+            /* Directory holding trees pending reclaim is hidden */
+            if (unlikely(ino == fs->fs_gfs->gfs_reclaimRoot) &&
+                (fs->fs_gindex == 0)) {
+                dirent = dirent->di_next;
+                continue;
+            }
             if (st) {
 
                 /* Add directory entry to the readdir buffer */
@@ -53,6 +53,12 @@ uint64_t
 lc_inodeEmapLookup(struct gfs *gfs, struct inode *inode, uint64_t page,
                    struct extent **extents) {
 
+    /* Pages of compressed files are cached separately from the blocks */
+    if (unlikely(inode->i_dinode.di_compressed)) {
+        return (page < LC_COMPRESS_MAX_PAGES) ?
+               lc_compressedBlock(inode->i_extentBlock, page) : LC_PAGE_HOLE;
+    }
+
     /* Check if the inode has a single direct extent */
     if (inode->i_extentLength && (page < inode->i_extentLength)) {
         return inode->i_extentBlock + page;
@@ -95,6 +101,9 @@ lc_inodeEmapUpdate(struct gfs *gfs, struct fs *fs, struct inode *inode,
     uint64_t end, ecount, bcount = 0;
 
     assert(!(inode->i_flags & LC_INODE_SHARED));
+    assert((lc_inodeGetSharedEmap(inode) == NULL) ||
+           (lc_getExtentStart(lc_inodeGetSharedEmap(inode)) >
+            (pstart + pcount)));
     assert(inode->i_extentLength == 0);
     assert(count);
 
@@ -201,23 +210,48 @@ lc_expandEmap(struct gfs *gfs, struct fs *fs, struct inode *inode) {
     lc_markInodeDirty(inode, LC_INODE_EMAPDIRTY);
 }
 
-/* Create a new emap extent list for the inode, copying emap list of parent */
+/* Make private copies of the extents shared with parent layer, which start
+ * at or before the specified page.  Rest of the emap list remains shared with
+ * parent layer, as parent layers are not modified while child layers exist.
+ * Modifying pages up to page - 1 does not touch the shared part of the list.
+ */
 void
-lc_copyEmap(struct gfs *gfs, struct fs *fs, struct inode *inode) {
-    struct extent **extents = lc_inodeGetEmapPtr(inode), *extent = *extents;
+lc_unshareEmap(struct gfs *gfs, struct fs *fs, struct inode *inode,
+               uint64_t page) {
+    struct extent **prev = lc_inodeGetEmapPtr(inode), *extent, *new;
 
     assert(S_ISREG(inode->i_mode));
+    extent = lc_inodeGetSharedEmap(inode);
+    if (extent == NULL) {
+        assert(!(inode->i_flags & LC_INODE_SHARED));
+        return;
+    }
     assert(inode->i_extentLength == 0);
-    lc_inodeSetEmap(inode, NULL);
-    while (extent) {
+
+    /* Find the private extent linking to the shared part of the list */
+    while (*prev != extent) {
+        prev = &((*prev)->ex_next);
+    }
+    inode->i_flags &= ~LC_INODE_SHARED;
+    while (extent && (lc_getExtentStart(extent) <= page)) {
         assert(extent->ex_type == LC_EXTENT_EMAP);
         lc_validateExtent(gfs, extent);
-        lc_addEmapExtent(gfs, fs, extents, lc_getExtentStart(extent),
-                         lc_getExtentBlock(extent), lc_getExtentCount(extent));
-        extents = &((*extents)->ex_next);
+        new = lc_malloc(fs, sizeof(struct extent), LC_MEMTYPE_EXTENT);
+        lc_initExtent(gfs, new, LC_EXTENT_EMAP, lc_getExtentStart(extent),
+                      lc_getExtentBlock(extent), lc_getExtentCount(extent),
+                      extent->ex_next);
+        *prev = new;
+        prev = &new->ex_next;
         extent = extent->ex_next;
     }
-    inode->i_flags &= ~LC_INODE_SHARED;
+    lc_inodeSetSharedEmap(inode, extent);
+}
+
+/* Create a new emap extent list for the inode, copying emap list of parent */
+void
+lc_copyEmap(struct gfs *gfs, struct fs *fs, struct inode *inode) {
+    lc_unshareEmap(gfs, fs, inode, LC_PAGE_HOLE);
+    assert(lc_inodeGetSharedEmap(inode) == NULL);
 }
 
 /* Allocate a emap block and flush to disk */
@@ -228,7 +262,7 @@ lc_flushEmapBlocks(struct gfs *gfs, struct fs *fs,
     uint64_t count = pcount, block;
     struct emapBlock *eblock;
 
-    block = lc_blockAllocExact(fs, pcount, true, true);
+    block = lc_metaAlloc(fs, pcount);
 
     /* Link the blocks together */
     while (page) {
@@ -243,10 +277,42 @@ lc_flushEmapBlocks(struct gfs *gfs, struct fs *fs,
         page = page->p_dnext;
     }
     assert(count == 0);
-    lc_addPageForWriteBack(gfs, fs, fpage, tpage, pcount);
+    lc_metaWriteBack(gfs, fs, fpage, tpage, pcount);
     return block;
 }
 
+/* Replace an emap list mapping pages from the start of the file to
+ * contiguous blocks with a single direct extent, so that blocks of the file
+ * could be computed without looking up the list.
+ */
+static void
+lc_emapCollapse(struct gfs *gfs, struct fs *fs, struct inode *inode) {
+    struct extent *extent = lc_inodeGetEmap(inode);
+    uint64_t block, count = 0;
+
+    /* Extents shared with parent layer cannot be freed */
+    if (lc_inodeGetSharedEmap(inode)) {
+        return;
+    }
+    block = lc_getExtentBlock(extent);
+    while (extent) {
+        assert(extent->ex_type == LC_EXTENT_EMAP);
+        if ((lc_getExtentStart(extent) != count) ||
+            (lc_getExtentBlock(extent) != (block + count))) {
+            return;
+        }
+        count += lc_getExtentCount(extent);
+        extent = extent->ex_next;
+    }
+    assert(inode->i_dinode.di_blocks == count);
+    while (lc_inodeGetEmap(inode)) {
+        lc_freeExtent(gfs, fs, lc_inodeGetEmap(inode),
+                      lc_inodeGetEmapPtr(inode), true);
+    }
+    inode->i_extentBlock = block;
+    inode->i_extentLength = count;
+}
+
 /* Flush blockmap of an inode */
 void
 lc_emapFlush(struct gfs *gfs, struct fs *fs, struct inode *inode) {
@@ -261,6 +327,9 @@ lc_emapFlush(struct gfs *gfs, struct fs *fs, struct inode *inode) {
 
     /* Flush all the dirty pages */
     lc_flushPages(gfs, fs, inode, true, false);
+    if (lc_inodeGetEmap(inode)) {
+        lc_emapCollapse(gfs, fs, inode);
+    }
     extent = lc_inodeGetEmap(inode);
     if (extent) {
         lc_printf("File %ld fragmented\n", inode->i_ino);
@@ -376,6 +445,19 @@ lc_freeInodeDataBlocks(struct gfs *gfs, struct fs *fs,
     struct extent *extent = *extents, *tmp;
     uint64_t block, len, count = 0;
 
+    /* Let the reclaimer invalidate pages and free blocks when a lot of
+     * blocks are freed, instead of stalling the caller.
+     */
+    while (extent && (count < LC_RECLAIM_DATA_MIN)) {
+        count += lc_getExtentCount(extent);
+        extent = extent->ex_next;
+    }
+    if (count >= LC_RECLAIM_DATA_MIN) {
+        lc_addReclaimExtents(fs, *extents);
+        return;
+    }
+    extent = *extents;
+    count = 0;
     while (extent) {
         block = lc_getExtentStart(extent);
         len = lc_getExtentCount(extent);
@@ -398,7 +480,7 @@ lc_freeInodeDataBlocks(struct gfs *gfs, struct fs *fs,
 bool
 lc_emapTruncate(struct gfs *gfs, struct fs *fs, struct inode *inode,
                 size_t size, uint64_t pg, bool remove) {
-    struct extent *extents = NULL, *extent, **prev, *next;
+    struct extent *extents = NULL, *extent, **prev, *next, *shared;
     uint64_t bcount = 0, estart, ecount, eblock, freed;
     bool zero = false;
 
@@ -432,9 +514,29 @@ lc_emapTruncate(struct gfs *gfs, struct fs *fs, struct inode *inode,
     if (lc_inodeGetEmap(inode)) {
         prev = lc_inodeGetEmapPtr(inode);
         extent = lc_inodeGetEmap(inode);
+        shared = lc_inodeGetSharedEmap(inode);
+        assert(!(inode->i_flags & LC_INODE_SHARED));
         while (extent) {
             assert(extent->ex_type == LC_EXTENT_EMAP);
             lc_validateExtent(gfs, extent);
+            if (extent == shared) {
+
+                /* Extents shared with parent layer are unlinked, not freed.
+                 * Those are all past the new size.
+                 */
+                while (remove && extent) {
+                    assert(pg < lc_getExtentStart(extent));
+                    ecount = lc_getExtentCount(extent);
+                    bcount += ecount;
+                    lc_addSpaceExtent(gfs, fs, &extents,
+                                      lc_getExtentBlock(extent), ecount,
+                                      false);
+                    extent = extent->ex_next;
+                }
+                *prev = NULL;
+                lc_inodeSetSharedEmap(inode, NULL);
+                break;
+            }
             if (!remove) {
 
                 /* Free the extent and continue on unmount */
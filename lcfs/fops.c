@@ -13,6 +13,19 @@ lc_epInit(struct fuse_entry_param *ep) {
     ep->entry_timeout = LC_TIMEOUT_SEC;
 }
 
+/* Check if a name refers to the directory holding trees pending reclaim or
+ * anything in it, which are hidden from users.
+ */
+static bool
+lc_reclaimName(struct fs *fs, ino_t parent, const char *name) {
+    struct gfs *gfs = fs->fs_gfs;
+
+    return gfs->gfs_reclaimRoot && (fs->fs_gindex == 0) &&
+           ((lc_getInodeHandle(parent) == gfs->gfs_reclaimRoot) ||
+            ((lc_getInodeHandle(parent) == LC_ROOT_INODE) &&
+             (strcmp(name, LC_LAYER_RECLAIM_DIR) == 0)));
+}
+
 /* Create a new directory entry and associated inode */
 static int
 lc_createInode(struct fs *fs, ino_t parent, const char *name, mode_t mode,
@@ -27,8 +40,11 @@ lc_createInode(struct fs *fs, ino_t parent, const char *name, mode_t mode,
         return EROFS;
     }
 
-    /* Do not allow file creations in layer root directory */
-    if (unlikely(parent == gfs->gfs_layerRoot)) {
+    /* Do not allow file creations in layer root directory and reclaim
+     * directory.
+     */
+    if (unlikely((parent == gfs->gfs_layerRoot) ||
+                 lc_reclaimName(fs, parent, name))) {
         lc_reportError(__func__, __LINE__, parent, EPERM);
         return EPERM;
     }
@@ -38,6 +54,12 @@ lc_createInode(struct fs *fs, ino_t parent, const char *name, mode_t mode,
         lc_reportError(__func__, __LINE__, parent, ENOSPC);
         return ENOSPC;
     }
+
+    /* Do not allow new files beyond the limits set on the layer */
+    if (!lc_quotaAvailable(fs, true)) {
+        lc_reportError(__func__, __LINE__, parent, EDQUOT);
+        return EDQUOT;
+    }
     dir = lc_getInode(fs, parent, NULL, true, true);
     if (unlikely(dir == NULL)) {
         lc_reportError(__func__, __LINE__, parent, ENOENT);
@@ -275,7 +297,8 @@ lc_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
         err = ENOENT;
         goto out;
     }
-    ino = lc_dirLookup(fs, dir, name);
+    ino = lc_reclaimName(fs, parent, name) ? LC_INVALID_INODE :
+                                             lc_dirLookup(fs, dir, name);
     if (ino == LC_INVALID_INODE) {
         lc_inodeUnlock(dir);
 
@@ -627,6 +650,115 @@ lc_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
     lc_unlock(fs);
 }
 
+/* Create the directory holding trees pending reclaim in the root directory,
+ * when the file system is formatted or mounted without one.
+ */
+void
+lc_createReclaimDir(struct gfs *gfs, struct fs *fs) {
+    struct fuse_entry_param e;
+    int err;
+
+    assert(fs == lc_getGlobalFs(gfs));
+    if (gfs->gfs_reclaimRoot || fs->fs_readOnly) {
+        return;
+    }
+    err = lc_createInode(fs, fs->fs_root, LC_LAYER_RECLAIM_DIR,
+                         S_IFDIR | 0700, 0, 0, 0, NULL, NULL, &e);
+    if (err == 0) {
+        gfs->gfs_reclaimRoot = e.ino;
+        lc_syslog(LOG_INFO, "reclaim root %ld\n", e.ino);
+    }
+}
+
+/* Check if a directory could be detached for removing in the background */
+static bool
+lc_detachable(struct fs *fs, ino_t parent, ino_t ino) {
+    struct gfs *gfs = fs->fs_gfs;
+
+    /* Special directories are handled inline */
+    return (ino != LC_INVALID_INODE) && (ino != gfs->gfs_reclaimRoot) &&
+           (ino != gfs->gfs_layerRoot) && (ino != gfs->gfs_tmp_root) &&
+           ((gfs->gfs_layerRootInode == NULL) ||
+            (ino != gfs->gfs_layerRootInode->i_parent)) &&
+           !lc_getIndex(fs, parent, ino);
+}
+
+/* Check if the named directory has any entries, without locking the reclaim
+ * directory, so that removing empty directories is not serialized.
+ */
+static bool
+lc_dirHasEntries(struct fs *fs, ino_t parent, const char *name) {
+    struct inode *pdir, *dir;
+    bool found = false;
+    ino_t ino;
+
+    pdir = lc_getInode(fs, parent, NULL, false, false);
+    if (pdir == NULL) {
+        return false;
+    }
+    ino = lc_dirLookup(fs, pdir, name);
+    lc_inodeUnlock(pdir);
+    if (lc_detachable(fs, parent, ino)) {
+        dir = lc_getInode(fs, ino, NULL, false, false);
+        if (dir) {
+            found = S_ISDIR(dir->i_mode) && dir->i_size;
+            lc_inodeUnlock(dir);
+        }
+    }
+    return found;
+}
+
+/* Detach a directory which is not empty from the name space and let the
+ * reclaimer remove everything under it in the background.  Return false if
+ * the directory needs to be removed inline.
+ */
+static bool
+lc_detachDir(struct fs *fs, ino_t parent, const char *name) {
+    struct inode *rdir, *pdir, *dir = NULL;
+    struct gfs *gfs = fs->fs_gfs;
+    ino_t ino;
+
+    if ((fs != lc_getGlobalFs(gfs)) || gfs->gfs_unmounting ||
+        (gfs->gfs_reclaimRoot == 0) ||
+        (lc_getInodeHandle(parent) == gfs->gfs_reclaimRoot) ||
+        !lc_dirHasEntries(fs, parent, name)) {
+        return false;
+    }
+
+    /* Lock reclaim directory first, like the reclaimer does */
+    rdir = lc_getInode(fs, gfs->gfs_reclaimRoot, NULL, true, true);
+    if (rdir == NULL) {
+        return false;
+    }
+    pdir = lc_getInode(fs, parent, NULL, true, true);
+    if (pdir == NULL) {
+        lc_inodeUnlock(rdir);
+        return false;
+    }
+    assert(S_ISDIR(pdir->i_mode));
+
+    /* Check again after locking, the directory could have changed */
+    ino = lc_dirLookup(fs, pdir, name);
+    if (lc_detachable(fs, parent, ino)) {
+        dir = lc_getInode(fs, ino, NULL, true, true);
+        if (dir && (!S_ISDIR(dir->i_mode) || (dir->i_size == 0))) {
+            lc_inodeUnlock(dir);
+            dir = NULL;
+        }
+    }
+    if (dir) {
+        lc_reclaimMove(rdir, pdir, dir, name);
+        lc_inodeUnlock(dir);
+    }
+    lc_inodeUnlock(pdir);
+    lc_inodeUnlock(rdir);
+    if (dir) {
+        lc_wakeupReclaimer(gfs);
+        return true;
+    }
+    return false;
+}
+
 /* Remove a directory */
 static void
 lc_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
@@ -638,6 +770,14 @@ lc_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
     lc_statsBegin(&start);
     lc_displayEntry(__func__, parent, 0, name);
     fs = lc_getLayerLocked(parent, false);
+
+    /* Directories which are not empty are removed in the background */
+    if (lc_detachDir(fs, parent, name)) {
+        fuse_reply_err(req, 0);
+        lc_statsAdd(fs, LC_RMDIR, 0, &start);
+        lc_unlock(fs);
+        return;
+    }
     err = lc_remove(fs, parent, name, (void **)&dir, true);
     fuse_reply_err(req, err);
     if (dir) {
@@ -714,6 +854,15 @@ lc_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
         goto out;
     }
 
+    /* Reclaim directory and anything in it are managed internally */
+    if (unlikely(lc_reclaimName(fs, parent, name) ||
+                 lc_reclaimName(fs, newparent, newname))) {
+        lc_reportError(__func__, __LINE__, parent, EPERM);
+        fuse_reply_err(req, EPERM);
+        err = EPERM;
+        goto out;
+    }
+
     /* Follow some locking order while locking the directories */
     if (tdirFirst) {
         tdir = lc_getInode(fs, newparent, NULL, true, true);
@@ -869,6 +1018,12 @@ lc_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent,
         err = EROFS;
         goto out;
     }
+    if (unlikely(lc_reclaimName(fs, newparent, newname))) {
+        lc_reportError(__func__, __LINE__, newparent, EPERM);
+        fuse_reply_err(req, EPERM);
+        err = EPERM;
+        goto out;
+    }
     dir = lc_getInode(fs, newparent, NULL, true, true);
     if (unlikely(dir == NULL)) {
         lc_reportError(__func__, __LINE__, newparent, ENOENT);
@@ -950,6 +1105,11 @@ lc_openInode(struct fs *fs, fuse_ino_t ino, struct fuse_file_info *fi) {
         return ESTALE;
     }
 
+    /* Kernel may cache pages of the file from now on */
+    if (S_ISREG(inode->i_mode)) {
+        lc_inodeKcached(inode->i_fs, inode);
+    }
+
     /* Increment open count if inode is private to this layer */
     if (inode->i_fs == fs) {
         if (trunc) {
@@ -1119,6 +1279,9 @@ lc_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
     pages = alloca(sizeof(struct page *) * pcount);
     memset(bufv, 0, fsize);
     fs = lc_getLayerLocked(ino, false);
+
+    /* Wait if the layer exceeded its I/O limits */
+    fs = lc_qosThrottle(fs, ino, 1, size);
     inode = lc_getInode(fs, ino, (struct inode *)fi->fh, false, false);
     if (unlikely(inode == NULL)) {
         lc_reportError(__func__, __LINE__, ino, ENOENT);
@@ -1156,6 +1319,8 @@ retry:
         lc_inodeLock(inode, false);
         goto retry;
     }
+    __sync_add_and_fetch(&fs->fs_freads, 1);
+    __sync_add_and_fetch(&fs->fs_freadBytes, endoffset - off);
 
 out:
     lc_waitMemory(fs->fs_gfs, false);
@@ -1502,7 +1667,8 @@ lc_ioctl(fuse_req_t req, fuse_ino_t ino, int cmd, void *arg,
         return;
     }
     if ((op != SYNCER_TIME) && (op != DCACHE_MEMORY) && (op != DCACHE_FLUSH) &&
-        (op != LCFS_COMMIT) && (op != LCFS_GROW)) {
+        (op != LCFS_COMMIT) && (op != LCFS_GROW) &&
+        (op != DCACHE_PIN_MEMORY)) {
         if (in_bufsz) {
             memcpy(name, in_buf, in_bufsz);
         }
@@ -1530,6 +1696,38 @@ lc_ioctl(fuse_req_t req, fuse_ino_t ino, int cmd, void *arg,
         lc_deleteLayer(req, gfs, name);
         break;
 
+    case LAYER_QOS:
+        lc_layerQos(req, gfs, name);
+        break;
+
+    case LAYER_QUOTA:
+        lc_layerQuota(req, gfs, name);
+        break;
+
+    case LAYER_PIN:
+        lc_layerPin(req, gfs, name);
+        break;
+
+    case LAYER_PREFETCH:
+        lc_layerPrefetch(req, gfs, name);
+        break;
+
+    case LAYER_SEND:
+        lc_layerSend(req, gfs, name);
+        break;
+
+    case LAYER_RECEIVE:
+        lc_layerReceive(req, gfs, name);
+        break;
+
+    case DCACHE_PIN_MEMORY:
+        value = lc_memoryPinLimit(atoll(in_buf) * 1024ull * 1024ull);
+        gfs->gfs_pinLimit = value / LC_BLOCK_SIZE;
+        lc_syslog(LOG_INFO, "Maximum memory allowed for pinned pages %ld MB\n",
+                  value / (1024 * 1024));
+        fuse_reply_ioctl(req, 0, NULL, 0);
+        break;
+
     case LAYER_MOUNT:
     case LAYER_STAT:
     case LAYER_UMOUNT:
@@ -1646,6 +1844,9 @@ lc_write_buf(fuse_req_t req, fuse_ino_t ino,
     memset(dst, 0, wsize);
     dpages = alloca(pcount * sizeof(struct dpage));
     fs = lc_getLayerLocked(ino, false);
+
+    /* Wait if the layer exceeded its I/O limits */
+    fs = lc_qosThrottle(fs, ino, 1, size);
     gfs = fs->fs_gfs;
     if (unlikely(fs->fs_frozen)) {
         lc_reportError(__func__, __LINE__, ino, EROFS);
@@ -1670,6 +1871,7 @@ lc_write_buf(fuse_req_t req, fuse_ino_t ino,
         err = ENOSPC;
         goto out;
     }
+
     inode = lc_getInode(fs, ino, (struct inode *)fi->fh, true, true);
     if (unlikely(inode == NULL)) {
         lc_reportError(__func__, __LINE__, ino, ENOENT);
@@ -1678,9 +1880,20 @@ lc_write_buf(fuse_req_t req, fuse_ino_t ino,
         goto out;
     }
 
+    /* Fail the write if the layer would exceed its limit on blocks */
+    if (!lc_quotaWrite(inode, off, size, pcount)) {
+        lc_inodeUnlock(inode);
+        lc_reportError(__func__, __LINE__, ino, EDQUOT);
+        fuse_reply_err(req, EDQUOT);
+        err = EDQUOT;
+        goto out;
+    }
+
     /* Now the write cannot fail, so respond success */
     fuse_reply_write(req, size);
     assert(S_ISREG(inode->i_mode));
+    __sync_add_and_fetch(&fs->fs_fwrites, 1);
+    __sync_add_and_fetch(&fs->fs_fwriteBytes, size);
 
     /* Link the dirty pages to the inode and update times */
     count = lc_addPages(inode, off, size, dpages, pcount);
@@ -1807,6 +2020,11 @@ lc_init(void *userdata, struct fuse_conn_info *conn) {
     /* Use splice */
     conn->want |= FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE;
 
+    /* Reply to large reads of image layers from the device when possible */
+    if ((conn->capable & FUSE_CAP_SPLICE_WRITE) && (gfs->gfs_sfd != -1)) {
+        gfs->gfs_splice = true;
+    }
+
     /* Let kernel take care of setuid business */
     conn->want &= ~FUSE_CAP_HANDLE_KILLPRIV;
 #else
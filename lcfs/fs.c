@@ -4,6 +4,7 @@
 struct fs *
 lc_newLayer(struct gfs *gfs, bool rw) {
     struct fs *fs = lc_malloc(NULL, sizeof(struct fs), LC_MEMTYPE_GFS);
+    int i;
 
     memset(fs, 0, sizeof(*fs));
     fs->fs_gfs = gfs;
@@ -17,7 +18,13 @@ lc_newLayer(struct gfs *gfs, bool rw) {
     pthread_mutex_init(&fs->fs_dilock, NULL);
     pthread_mutex_init(&fs->fs_alock, NULL);
     pthread_mutex_init(&fs->fs_hlock, NULL);
-    pthread_rwlock_init(&fs->fs_rwlock, NULL);
+    pthread_mutex_init(&fs->fs_klock, NULL);
+    lc_mallocCacheAligned(NULL, (void **)&fs->fs_rwlock,
+                          LC_LAYER_LOCK_SLOTS * sizeof(union lslot),
+                          LC_MEMTYPE_GFS);
+    for (i = 0; i < LC_LAYER_LOCK_SLOTS; i++) {
+        pthread_rwlock_init(&fs->fs_rwlock[i].ls_lock, NULL);
+    }
     __sync_add_and_fetch(&gfs->gfs_count, 1);
     return fs;
 }
@@ -68,7 +75,7 @@ lc_flushInodeBlocks(struct gfs *gfs, struct fs *fs) {
         return;
     }
     lc_releaseInodeBlock(gfs, fs);
-    block = lc_blockAllocExact(fs, pcount, true, true);
+    block = lc_metaAlloc(fs, pcount);
     fpage = fs->fs_inodeBlockPages;
     page = fpage;
     count = pcount;
@@ -84,7 +91,7 @@ lc_flushInodeBlocks(struct gfs *gfs, struct fs *fs) {
         page = page->p_dnext;
     }
     assert(count == 0);
-    lc_addPageForWriteBack(gfs, fs, fpage, tpage, pcount);
+    lc_metaWriteBack(gfs, fs, fpage, tpage, pcount);
     fs->fs_inodeBlockCount = 0;
     fs->fs_inodeBlockPages = NULL;
     fs->fs_super->sb_inodeBlock = block;
@@ -109,6 +116,9 @@ lc_newInodeBlock(struct gfs *gfs, struct fs *fs) {
 void
 lc_freeLayer(struct fs *fs, bool remove) {
     struct gfs *gfs = fs->fs_gfs;
+#ifdef LC_RWLOCK_DESTROY
+    int i;
+#endif
 
     assert(fs->fs_dpcount == 0);
     assert(fs->fs_dpages == NULL);
@@ -123,6 +133,8 @@ lc_freeLayer(struct fs *fs, bool remove) {
     assert(fs->fs_extents == NULL);
     assert(fs->fs_aextents == NULL);
     assert(fs->fs_fextents == NULL);
+    assert(fs->fs_rextents == NULL);
+    assert(fs->fs_iextents == NULL);
     assert(fs->fs_icount == 0);
     assert(fs->fs_pcount == 0);
     assert(!remove || (fs->fs_blocks == fs->fs_freed));
@@ -133,6 +145,11 @@ lc_freeLayer(struct fs *fs, bool remove) {
     lc_destroyPages(gfs, fs, remove);
     assert(fs->fs_bcache == NULL);
     lc_statsDeinit(fs);
+    lc_qosFree(fs);
+    if (fs->fs_manifest) {
+        lc_manifestFree(fs, fs->fs_manifest);
+        fs->fs_manifest = NULL;
+    }
 #ifdef LC_MUTEX_DESTROY
 #ifndef LC_IC_LOCK
     pthread_mutex_destroy(&fs->fs_ilock);
@@ -141,10 +158,15 @@ lc_freeLayer(struct fs *fs, bool remove) {
     pthread_mutex_destroy(&fs->fs_plock);
     pthread_mutex_destroy(&fs->fs_alock);
     pthread_mutex_destroy(&fs->fs_hlock);
+    pthread_mutex_destroy(&fs->fs_klock);
 #endif
 #ifdef LC_RWLOCK_DESTROY
-    pthread_rwlock_destroy(&fs->fs_rwlock);
+    for (i = 0; i < LC_LAYER_LOCK_SLOTS; i++) {
+        pthread_rwlock_destroy(&fs->fs_rwlock[i].ls_lock);
+    }
 #endif
+    lc_free(NULL, fs->fs_rwlock, LC_LAYER_LOCK_SLOTS * sizeof(union lslot),
+            LC_MEMTYPE_GFS);
     __sync_sub_and_fetch(&gfs->gfs_count, 1);
     assert(!fs->fs_inodesDirty || fs->fs_removed);
     assert(!fs->fs_extentsDirty || fs->fs_removed);
@@ -166,23 +188,88 @@ lc_destroyLayer(struct fs *fs, bool remove) {
     lc_freeLayer(fs, remove);
 }
 
+/* Slot of layer locks used by this thread for locking layers shared */
+static __thread int lc_lockSlot = -1;
+
+/* Number of threads assigned a slot of layer locks */
+static int lc_lockThreads;
+
+/* Return the lock of the layer used by the calling thread for locking the
+ * layer shared.  Threads are assigned a slot on first use, so that threads
+ * reading from the same layer do not contend on the same lock.
+ */
+pthread_rwlock_t *
+lc_getLayerLock(struct fs *fs) {
+    if (unlikely(lc_lockSlot < 0)) {
+        lc_lockSlot = __sync_fetch_and_add(&lc_lockThreads, 1) %
+                      LC_LAYER_LOCK_SLOTS;
+    }
+    return &fs->fs_rwlock[lc_lockSlot].ls_lock;
+}
+
 /* Lock a file system in shared while starting a request.
  * File system is locked in exclusive mode while taking/deleting layers.
  */
 void
 lc_lock(struct fs *fs, bool exclusive) {
+    int i;
+
     if (exclusive) {
-        pthread_rwlock_wrlock(&fs->fs_rwlock);
+
+        /* Take all the locks in order */
+        for (i = 0; i < LC_LAYER_LOCK_SLOTS; i++) {
+            pthread_rwlock_wrlock(&fs->fs_rwlock[i].ls_lock);
+        }
+        fs->fs_xlocked = true;
     } else {
-        pthread_rwlock_rdlock(&fs->fs_rwlock);
+        pthread_rwlock_rdlock(lc_getLayerLock(fs));
     }
 }
 
 /* Trylock variant of the above */
 int
 lc_tryLock(struct fs *fs, bool exclusive) {
-    return exclusive ? pthread_rwlock_trywrlock(&fs->fs_rwlock) :
-                       pthread_rwlock_tryrdlock(&fs->fs_rwlock);
+    int i, err;
+
+    if (!exclusive) {
+        return pthread_rwlock_tryrdlock(lc_getLayerLock(fs));
+    }
+    for (i = 0; i < LC_LAYER_LOCK_SLOTS; i++) {
+        err = pthread_rwlock_trywrlock(&fs->fs_rwlock[i].ls_lock);
+        if (err) {
+
+            /* Release locks taken so far */
+            while (i--) {
+                pthread_rwlock_unlock(&fs->fs_rwlock[i].ls_lock);
+            }
+            return err;
+        }
+    }
+    fs->fs_xlocked = true;
+    return 0;
+}
+
+/* Lock a layer exclusive, waiting up to the specified number of seconds */
+int
+lc_timedLock(struct fs *fs, time_t seconds) {
+    struct timespec timeout;
+    int i, err;
+
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_sec += seconds;
+    for (i = 0; i < LC_LAYER_LOCK_SLOTS; i++) {
+        err = pthread_rwlock_timedwrlock(&fs->fs_rwlock[i].ls_lock, &timeout);
+        if (err) {
+
+            /* Release locks taken so far */
+            while (i--) {
+                pthread_rwlock_unlock(&fs->fs_rwlock[i].ls_lock);
+            }
+            return err;
+        }
+    }
+    fs->fs_xlocked = true;
+    return 0;
 }
 
 /* Lock a layer exclusive */
@@ -192,10 +279,21 @@ lc_lockExclusive(struct fs *fs) {
     fs->fs_locked = true;
 }
 
-/* Unlock the file system */
+/* Unlock the file system.  Layer cannot be locked shared while it is locked
+ * exclusive, so the flag tells which mode the caller holds the lock in.
+ */
 void
 lc_unlock(struct fs *fs) {
-    pthread_rwlock_unlock(&fs->fs_rwlock);
+    int i;
+
+    if (fs->fs_xlocked) {
+        fs->fs_xlocked = false;
+        for (i = LC_LAYER_LOCK_SLOTS - 1; i >= 0; i--) {
+            pthread_rwlock_unlock(&fs->fs_rwlock[i].ls_lock);
+        }
+    } else {
+        pthread_rwlock_unlock(lc_getLayerLock(fs));
+    }
 }
 
 /* Unlock an exclusively locked layer */
@@ -467,15 +565,25 @@ lc_gfsInit(struct gfs *gfs) {
     lc_mallocBlockAligned(NULL, (void **)&gfs->gfs_zPage, LC_MEMTYPE_GFS);
     memset(gfs->gfs_zPage, 0, LC_BLOCK_SIZE);
     memset(gfs->gfs_roots, 0, sizeof(ino_t) * LC_LAYER_MAX);
+    gfs->gfs_mstats = lc_malloc(NULL, sizeof(struct mstats), LC_MEMTYPE_GFS);
+    memset(gfs->gfs_mstats, 0, sizeof(struct mstats));
     gfs->gfs_syncInterval = LC_SYNC_INTERVAL;
+    gfs->gfs_pinLimit = LC_PIN_MEMORY / LC_BLOCK_SIZE;
     pthread_cond_init(&gfs->gfs_mcond, NULL);
     pthread_cond_init(&gfs->gfs_flusherCond, NULL);
     pthread_cond_init(&gfs->gfs_cleanerCond, NULL);
+    pthread_cond_init(&gfs->gfs_iocond, NULL);
+    pthread_cond_init(&gfs->gfs_reclaimCond, NULL);
+    pthread_cond_init(&gfs->gfs_prefetchCond, NULL);
     pthread_mutex_init(&gfs->gfs_lock, NULL);
     pthread_mutex_init(&gfs->gfs_alock, NULL);
     pthread_mutex_init(&gfs->gfs_clock, NULL);
     pthread_mutex_init(&gfs->gfs_flock, NULL);
     pthread_mutex_init(&gfs->gfs_slock, NULL);
+    pthread_mutex_init(&gfs->gfs_iolock, NULL);
+    pthread_mutex_init(&gfs->gfs_rclock, NULL);
+    pthread_mutex_init(&gfs->gfs_pflock, NULL);
+    lc_nameInit(gfs);
 }
 
 /* Free resources allocated for the global file system */
@@ -497,10 +605,15 @@ lc_gfsDeinit(struct gfs *gfs) {
             LC_MEMTYPE_GFS);
     lc_free(NULL, gfs->gfs_roots, sizeof(ino_t) * LC_LAYER_MAX,
             LC_MEMTYPE_GFS);
+    lc_free(NULL, gfs->gfs_mstats, sizeof(struct mstats), LC_MEMTYPE_GFS);
+    lc_nameDeinit(gfs);
 #ifdef LC_COND_DESTROY
     pthread_cond_destroy(&gfs->gfs_mcond);
     pthread_cond_destroy(&gfs->gfs_flusherCond);
     pthread_cond_destroy(&gfs->gfs_cleanerCond);
+    pthread_cond_destroy(&gfs->gfs_iocond);
+    pthread_cond_destroy(&gfs->gfs_reclaimCond);
+    pthread_cond_destroy(&gfs->gfs_prefetchCond);
 #endif
 #ifdef LC_MUTEX_DESTROY
     pthread_mutex_destroy(&gfs->gfs_lock);
@@ -508,6 +621,9 @@ lc_gfsDeinit(struct gfs *gfs) {
     pthread_mutex_destroy(&gfs->gfs_clock);
     pthread_mutex_destroy(&gfs->gfs_flock);
     pthread_mutex_destroy(&gfs->gfs_slock);
+    pthread_mutex_destroy(&gfs->gfs_iolock);
+    pthread_mutex_destroy(&gfs->gfs_rclock);
+    pthread_mutex_destroy(&gfs->gfs_pflock);
 #endif
 }
 
@@ -526,6 +642,8 @@ lc_initLayer(struct gfs *gfs, struct fs *pfs, uint64_t block, bool child) {
     assert(!(pfs->fs_super->sb_flags & LC_SUPER_DIRTY));
     fs->fs_restarted = true;
     fs->fs_root = fs->fs_super->sb_root;
+    fs->fs_blockLimit = fs->fs_super->sb_blockLimit;
+    fs->fs_inodeLimit = fs->fs_super->sb_inodeLimit;
     if (child) {
 
         /* First child layer of the parent */
@@ -618,6 +736,11 @@ lc_setupSpecialInodes(struct gfs *gfs, struct fs *fs) {
         gfs->gfs_tmp_root = ino;
         lc_syslog(LOG_INFO, "tmp root %ld\n", ino);
     }
+    ino = lc_dirLookup(fs, dir, LC_LAYER_RECLAIM_DIR);
+    if (ino != LC_INVALID_INODE) {
+        gfs->gfs_reclaimRoot = ino;
+        lc_syslog(LOG_INFO, "reclaim root %ld\n", ino);
+    }
     ino = lc_dirLookup(fs, dir, LC_LAYER_ROOT_DIR);
     if (ino != LC_INVALID_INODE) {
         dir = lc_getInode(lc_getGlobalFs(gfs), ino, NULL, false, true);
@@ -637,12 +760,18 @@ lc_setupSpecialInodes(struct gfs *gfs, struct fs *fs) {
 void
 lc_mount(struct gfs *gfs, char *device, bool ftypes, size_t size,
          bool format) {
+    struct timeval start, pstart, lstart;
+    uint64_t reads, preads, lreads;
     bool grow = false;
     struct fs *fs;
     int i;
 
     lc_gfsInit(gfs);
 
+    /* Track time and I/O spent in each phase of mount */
+    gfs->gfs_mstats->ms_active = true;
+    lc_mountStatsBegin(gfs, &start, &reads);
+
     /* Initialize a file system structure in memory */
     fs = lc_newLayer(gfs, true);
     lc_icache_init(fs, LC_ICACHE_SIZE_MAX);
@@ -656,11 +785,14 @@ lc_mount(struct gfs *gfs, char *device, bool ftypes, size_t size,
     lc_lock(fs, true);
 
     /* Try to find a valid superblock, if not found, format the device */
+    lc_mountStatsBegin(gfs, &pstart, &preads);
     lc_superRead(gfs, fs, fs->fs_sblock);
+    lc_mountStatsAdd(gfs, LC_MOUNT_SUPER, &pstart, preads);
     gfs->gfs_super = fs->fs_super;
     if (format || !lc_superValid(gfs->gfs_super)) {
         lc_syslog(LOG_INFO, "Formatting %s, size %ld\n", device, size);
         lc_format(gfs, fs, ftypes, size);
+        lc_createReclaimDir(gfs, fs);
     } else {
         if (size > (gfs->gfs_super->sb_tblocks * LC_BLOCK_SIZE)) {
             grow = true;
@@ -674,20 +806,32 @@ lc_mount(struct gfs *gfs, char *device, bool ftypes, size_t size,
         if (gfs->gfs_super->sb_pcache) {
             lc_memoryInit(gfs->gfs_super->sb_pcache);
         }
+        lc_mountStatsBegin(gfs, &pstart, &preads);
+        lc_superReadTable(gfs, fs);
         lc_initLayers(gfs, fs);
+        lc_superFreeTable(gfs, fs);
+        lc_mountStatsAdd(gfs, LC_MOUNT_LAYERS, &pstart, preads);
         for (i = 0; i <= gfs->gfs_scount; i++) {
             fs = gfs->gfs_fs[i];
             if (fs) {
+                lc_mountStatsBegin(gfs, &lstart, &lreads);
                 lc_readExtents(gfs, fs);
+                lc_mountStatsAdd(gfs, LC_MOUNT_EXTENTS, &lstart, lreads);
+                lc_mountStatsBegin(gfs, &pstart, &preads);
                 lc_readInodes(gfs, fs);
+                lc_mountStatsAdd(gfs, LC_MOUNT_INODES, &pstart, preads);
+                lc_mountLayerStats(gfs, fs, &lstart, lreads);
                 if (i) {
                     fs->fs_locked = false;
                 }
             }
         }
         fs = lc_getGlobalFs(gfs);
+        lc_mountStatsBegin(gfs, &pstart, &preads);
         lc_setupSpecialInodes(gfs, fs);
+        lc_createReclaimDir(gfs, fs);
         lc_cleanupAfterRestart(gfs, fs);
+        lc_mountStatsAdd(gfs, LC_MOUNT_CLEANUP, &pstart, preads);
         lc_validate(gfs);
     }
     fs->fs_mcount = 1;
@@ -704,6 +848,11 @@ lc_mount(struct gfs *gfs, char *device, bool ftypes, size_t size,
     if (grow) {
         lc_grow(gfs);
     }
+
+    /* Report time and I/O spent for mounting the device */
+    lc_mountStatsAdd(gfs, LC_MOUNT_TOTAL, &start, reads);
+    gfs->gfs_mstats->ms_active = false;
+    lc_displayMountStats(gfs);
 }
 
 /* Sync a dirty inodes in a layer */
@@ -715,6 +864,7 @@ lc_sync(struct gfs *gfs, struct fs *fs, bool unmount) {
         lc_syncInodes(gfs, fs, unmount);
         fs->fs_inodesDirty = false;
     }
+    fs->fs_dirtyTime = 0;
 }
 
 /* Sync and destroy root layer */
@@ -786,6 +936,13 @@ lc_unmount(struct gfs *gfs) {
     struct fs *fs = lc_getGlobalFs(gfs);
 
     assert(gfs->gfs_unmounting);
+
+    /* Prefetch threads stop when unmounting is noticed */
+    pthread_mutex_lock(&gfs->gfs_pflock);
+    while (gfs->gfs_prefetchers) {
+        pthread_cond_wait(&gfs->gfs_prefetchCond, &gfs->gfs_pflock);
+    }
+    pthread_mutex_unlock(&gfs->gfs_pflock);
     lc_lockExclusive(fs);
     assert(fs->fs_mcount == 1);
     fs->fs_mcount = 0;
@@ -829,6 +986,7 @@ lc_commitRoot(struct gfs *gfs, int count) {
     /* Lock the layer exclusive and flush everything and write out superblock
      */
     if (lc_tryLock(fs, true)) {
+        __sync_add_and_fetch(&gfs->gfs_syncSkipped, 1);
         return;
     }
     if ((gfs->gfs_layerInProgress == 0) && (count == gfs->gfs_syncRequired)) {
@@ -852,65 +1010,135 @@ lc_commitRoot(struct gfs *gfs, int count) {
     lc_unlock(fs);
 }
 
-/* Commit the file system to a consistent state */
+/* Schedule a retry of the checkpoint if some layers were skipped, backing
+ * off each time, otherwise reset the backoff.
+ */
+static void
+lc_commitRetry(struct gfs *gfs, bool retry) {
+    if (!retry) {
+        gfs->gfs_syncRetry = 0;
+        return;
+    }
+    if (gfs->gfs_syncRetry < LC_SYNC_RETRY_MAX) {
+        gfs->gfs_syncRetry++;
+    }
+
+    /* Keep the checkpoint pending */
+    lc_layerChanged(gfs, false, false);
+}
+
+/* Check if a mounted read-write layer needs to be checkpointed.  Those are
+ * checkpointed once metadata stayed dirty for a sync interval, so that
+ * metadata of running containers is not left unsynced until unmount.
+ */
+static bool
+lc_commitMounted(struct gfs *gfs, struct fs *fs, time_t now) {
+    return fs->fs_fextents || (fs->fs_dirtyTime &&
+           ((now - fs->fs_dirtyTime) >= gfs->gfs_syncInterval));
+}
+
+/* Check if a mounted read-write layer stayed dirty for too long, so that the
+ * syncer should wait for the lock of the layer instead of skipping it.
+ */
+static bool
+lc_commitOverdue(struct gfs *gfs, struct fs *fs, time_t now) {
+    return !fs->fs_frozen && fs->fs_dirtyTime &&
+           ((now - fs->fs_dirtyTime) >=
+            (LC_SYNC_WAIT_INTERVALS * gfs->gfs_syncInterval));
+}
+
+/* Commit the file system to a consistent state.  Layers which cannot be
+ * locked without waiting are skipped and retried later with a backoff, unless
+ * a mounted layer stayed dirty for too long.  The root layer is not committed
+ * while every layer to sync is skipped, until the backoff reaches the maximum.
+ */
 void
 lc_commit(struct gfs *gfs) {
+    bool skipped = false, pending = false, synced = false;
     int i, count, gindex;
     struct fs *fs;
+    time_t now;
 
-    if (gfs->gfs_layerInProgress || (gfs->gfs_syncRequired == 0)) {
+    if (gfs->gfs_syncRequired == 0) {
+        return;
+    }
+    if (gfs->gfs_layerInProgress) {
+        lc_commitRetry(gfs, true);
         return;
     }
 
     /* Sync all layers */
+    now = time(NULL);
     rcu_register_thread();
     rcu_read_lock();
     count = gfs->gfs_syncRequired;
     for (i = 1; i <= gfs->gfs_scount; i++) {
         fs = rcu_dereference(gfs->gfs_fs[i]);
         if ((fs == NULL) ||
-            (!fs->fs_frozen && fs->fs_mcount && (fs->fs_fextents == NULL)) ||
             (!fs->fs_inodesDirty && !fs->fs_extentsDirty &&
              (fs->fs_fextents == NULL))) {
             continue;
         }
+
+        /* Keep the checkpoint pending for mounted layers not synced now */
+        if (!fs->fs_frozen && fs->fs_mcount &&
+            !lc_commitMounted(gfs, fs, now)) {
+            pending = true;
+            continue;
+        }
         gindex = fs->fs_gindex;
 
         /* Flush dirty pages with shared lock first */
         if (fs->fs_dpcount || fs->fs_pcount) {
             if (lc_tryLock(fs, false)) {
-                rcu_read_unlock();
-                rcu_unregister_thread();
-                return;
+                __sync_add_and_fetch(&gfs->gfs_syncSkipped, 1);
+                skipped = true;
+                continue;
             }
             rcu_read_unlock();
             if (gfs->gfs_layerInProgress) {
                 lc_unlock(fs);
                 rcu_unregister_thread();
+                lc_commitRetry(gfs, true);
                 return;
             }
             assert(gindex == fs->fs_gindex);
             lc_flushDirtyInodeList(fs, true);
             lc_flushDirtyPages(gfs, fs);
             lc_unlock(fs);
+            synced = true;
             rcu_read_lock();
             fs = rcu_dereference(gfs->gfs_fs[i]);
         }
 
         /* Lock the layer exclusive and flush all dirty inodes and
-         * allocated extent list.
+         * allocated extent list.  Skip the layer if it is busy, unless the
+         * layer stayed dirty for too long.  Waiting is bounded, as a layer
+         * being removed is locked while waiting for readers of the layer
+         * list to finish.
          */
-        if ((fs == NULL) || (gindex != fs->fs_gindex) ||
-            gfs->gfs_layerInProgress || lc_tryLock(fs, true)) {
+        if ((fs == NULL) || (gindex != fs->fs_gindex)) {
+            continue;
+        }
+        if (gfs->gfs_layerInProgress) {
             rcu_read_unlock();
             rcu_unregister_thread();
+            lc_commitRetry(gfs, true);
             return;
         }
+        if (lc_tryLock(fs, true) &&
+            (!lc_commitOverdue(gfs, fs, now) ||
+             lc_timedLock(fs, LC_SYNC_WAIT_TIME))) {
+            __sync_add_and_fetch(&gfs->gfs_syncSkipped, 1);
+            skipped = true;
+            continue;
+        }
         rcu_read_unlock();
         assert(gindex == fs->fs_gindex);
         if (gfs->gfs_layerInProgress) {
             lc_unlock(fs);
             rcu_unregister_thread();
+            lc_commitRetry(gfs, true);
             return;
         }
         lc_sync(gfs, fs, false);
@@ -920,6 +1148,7 @@ lc_commit(struct gfs *gfs) {
             fs->fs_super->sb_flags &= ~LC_SUPER_DIRTY;
         }
         lc_unlock(fs);
+        synced = true;
         rcu_read_lock();
     }
 
@@ -928,23 +1157,34 @@ lc_commit(struct gfs *gfs) {
         fs = rcu_dereference(gfs->gfs_fs[i]);
         if (fs && fs->fs_frozen && fs->fs_dpcount) {
             if (lc_tryLock(fs, false)) {
-                rcu_read_unlock();
-                rcu_unregister_thread();
-                return;
+                __sync_add_and_fetch(&gfs->gfs_syncSkipped, 1);
+                skipped = true;
+                continue;
             }
             rcu_read_unlock();
             lc_flushDirtyPages(gfs, fs);
             lc_unlock(fs);
+            synced = true;
             rcu_read_lock();
         }
     }
     rcu_read_unlock();
     rcu_unregister_thread();
+
+    /* Back off committing the root layer as well if all layers were busy */
+    if (skipped && !synced && (gfs->gfs_syncRetry < LC_SYNC_RETRY_MAX)) {
+        lc_commitRetry(gfs, true);
+        return;
+    }
     if ((gfs->gfs_layerInProgress == 0) && (count == gfs->gfs_syncRequired)) {
 
         /* Sync everything from the root layer */
         lc_commitRoot(gfs, count);
     }
+    lc_commitRetry(gfs, skipped);
+    if (pending) {
+        lc_layerChanged(gfs, false, false);
+    }
 }
 
 /* Commit file system periodically */
@@ -953,16 +1193,31 @@ lc_syncer(void *data) {
     struct gfs *gfs = (struct gfs *)data;
     struct timespec interval;
     struct timeval now;
+    int wait, retry;
 
     lc_printf("Syncer interval is %d seconds\n", gfs->gfs_syncInterval);
+
+    /* Checkpoints hold layers locked, so those are not deferred for reads
+     * waiting on the same layers.
+     */
+    lc_ioSetClass(LC_IO_SYNC);
     interval.tv_nsec = 0;
     while (!gfs->gfs_unmounting) {
-        if (gfs->gfs_syncInterval == 0) {
+
+        /* Retry sooner if the last checkpoint skipped busy layers */
+        wait = gfs->gfs_syncInterval;
+        if (gfs->gfs_syncRetry) {
+            retry = 1 << (gfs->gfs_syncRetry - 1);
+            if ((wait == 0) || (retry < wait)) {
+                wait = retry;
+            }
+        }
+        if (wait == 0) {
             pthread_mutex_lock(&gfs->gfs_slock);
             pthread_cond_wait(&gfs->gfs_syncerCond, &gfs->gfs_slock);
         } else {
             gettimeofday(&now, NULL);
-            interval.tv_sec = now.tv_sec + gfs->gfs_syncInterval;
+            interval.tv_sec = now.tv_sec + wait;
             pthread_mutex_lock(&gfs->gfs_slock);
             pthread_cond_timedwait(&gfs->gfs_syncerCond, &gfs->gfs_slock,
                                    &interval);
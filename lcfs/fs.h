@@ -16,12 +16,67 @@ enum lc_mountId {
 /* Time in seconds syncer is woken to checkpoint file system */
 #define LC_SYNC_INTERVAL       60
 
+/* Maximum number of times retry of a checkpoint is backed off, starting with
+ * a second and doubling each time.
+ */
+#define LC_SYNC_RETRY_MAX      6
+
+/* Number of sync intervals a mounted layer could stay dirty before the syncer
+ * waits for the lock of the layer, instead of skipping it when busy.
+ */
+#define LC_SYNC_WAIT_INTERVALS 4
+
+/* Seconds syncer waits for the lock of a busy layer */
+#define LC_SYNC_WAIT_TIME      1
+
+/* Priority classes of device I/O, highest priority first */
+enum lc_ioClass {
+    LC_IO_READ = 0,         /* Reads issued for applications */
+    LC_IO_SYNC = 1,         /* Writes applications or checkpoints wait on */
+    LC_IO_WRITEBACK = 2,    /* Dirty pages written by flusher */
+    LC_IO_BACKGROUND = 3,   /* Prefetch, reclaim and other maintenance */
+    LC_IO_CLASS_MAX = 4,    /* Number of I/O classes */
+} __attribute__((packed));
+
+/* Maximum writeback I/Os in flight */
+#define LC_IO_WRITEBACK_MAX    8
+
+/* Maximum background I/Os in flight */
+#define LC_IO_BACKGROUND_MAX   2
+
+/* Maximum time in milliseconds an I/O waits for higher priority I/Os */
+#define LC_IO_DEFER_TIME       10
+
+/* Maximum number of NUMA nodes tracked */
+#define LC_NUMA_NODES_MAX      16
+
+/* Maximum number of CPUs tracked for finding NUMA nodes */
+#define LC_NUMA_CPUS_MAX       1024
+
+/* Number of locks a layer lock is made of.  Threads take different locks
+ * when locking a layer shared, while all of those are taken for locking the
+ * layer exclusive.
+ */
+#define LC_LAYER_LOCK_SLOTS    16
+
+/* Size of a CPU cache line */
+#define LC_CACHELINE_SIZE      64
+
+/* A lock of a layer lock, padded to a cache line */
+union lslot {
+    pthread_rwlock_t ls_lock;
+    char ls_pad[LC_CACHELINE_SIZE];
+};
+
 /* Global file system */
 struct gfs {
 
     /* File descriptor of the underlying device */
     int gfs_fd;
 
+    /* File descriptor of the device for splicing read replies, -1 if none */
+    int gfs_sfd;
+
     /* Last index in use in gfs_fs/gfs_roots */
     int gfs_scount;
 
@@ -37,6 +92,9 @@ struct gfs {
     /* Inode of tmp directory */
     ino_t gfs_tmp_root;
 
+    /* Inode of directory holding trees pending removal */
+    ino_t gfs_reclaimRoot;
+
     /* Inode of local-kv.db */
     ino_t gfs_dbIno;
 
@@ -110,6 +168,36 @@ struct gfs {
     /* Condition variable syncer thread is waiting on */
     pthread_cond_t gfs_syncerCond;
 
+    /* Lock protecting reclaimer wakeups */
+    pthread_mutex_t gfs_rclock;
+
+    /* Condition variable reclaimer thread is waiting on */
+    pthread_cond_t gfs_reclaimCond;
+
+    /* Lock protecting I/O scheduling */
+    pthread_mutex_t gfs_iolock;
+
+    /* Condition variable low priority I/Os wait on */
+    pthread_cond_t gfs_iocond;
+
+    /* I/Os in flight in each priority class */
+    uint64_t gfs_ioActive[LC_IO_CLASS_MAX];
+
+    /* I/Os deferred for higher priority I/Os */
+    uint64_t gfs_ioDeferred;
+
+    /* Number of I/Os waiting for higher priority I/Os to complete */
+    uint64_t gfs_ioWaiting;
+
+    /* Number of prefetch threads running */
+    uint64_t gfs_prefetchers;
+
+    /* Lock protecting prefetcher exits */
+    pthread_mutex_t gfs_pflock;
+
+    /* Condition variable unmount waits on for prefetchers to exit */
+    pthread_cond_t gfs_prefetchCond;
+
     /* Count of pages in use */
     uint64_t gfs_pcount;
 
@@ -143,6 +231,60 @@ struct gfs {
     /* Pages reused */
     uint64_t gfs_preused;
 
+    /* Pages hit in cache, allocated on the NUMA node of the reader */
+    uint64_t gfs_plocal;
+
+    /* Pages hit in cache, allocated on another NUMA node */
+    uint64_t gfs_premote;
+
+    /* Pages pinned in cache */
+    uint64_t gfs_ppinned;
+
+    /* Maximum number of pages allowed to be pinned */
+    uint64_t gfs_pinLimit;
+
+    /* Pages not pinned as pinned pages were at the limit */
+    uint64_t gfs_pinDenied;
+
+    /* Directory entries removed in the background */
+    uint64_t gfs_reclaimed;
+
+    /* Blocks of files released in the background */
+    uint64_t gfs_reclaimedBlocks;
+
+    /* Layers skipped by checkpoints as those were busy */
+    uint64_t gfs_syncSkipped;
+
+    /* Pages of files stored compressed */
+    uint64_t gfs_zpages;
+
+    /* Blocks used for storing compressed files */
+    uint64_t gfs_zblocks;
+
+    /* Clusters of compressed pages read */
+    uint64_t gfs_zreads;
+
+    /* Pages spliced from the device without caching */
+    uint64_t gfs_pspliced;
+
+    /* Hash table of file names used in directories of all layers */
+    struct lname **gfs_names;
+
+    /* Locks protecting hash lists of gfs_names */
+    pthread_mutex_t *gfs_nlocks;
+
+    /* Number of distinct names in gfs_names */
+    uint64_t gfs_ncount;
+
+    /* Number of times an existing name was reused by a directory entry */
+    uint64_t gfs_nshared;
+
+    /* Stats collected while mounting the device */
+    struct mstats *gfs_mstats;
+
+    /* Layer superblocks read from the table while mounting */
+    struct super **gfs_stable;
+
     /* Sync interval in seconds */
     int gfs_syncInterval;
 
@@ -152,9 +294,15 @@ struct gfs {
     /* Set if layers are pending flush */
     int gfs_syncRequired;
 
+    /* Number of consecutive checkpoints which skipped busy layers */
+    int gfs_syncRetry;
+
     /* Layer from pages being purged */
     int gfs_cleanerIndex;
 
+    /* Time block caches were rebalanced last time */
+    time_t gfs_balanceTime;
+
     /* Number of mounts */
     uint8_t gfs_mcount;
 
@@ -164,6 +312,9 @@ struct gfs {
     /* Pages being purged */
     bool gfs_pcleaning;
 
+    /* Set when reclaimer has work to do */
+    bool gfs_reclaimWakeup;
+
     /* Set when purging of pages forced */
     bool gfs_pcleaningForced;
 
@@ -180,8 +331,58 @@ struct gfs {
 
     /* Set if layers are swapped during commit */
     bool gfs_swapLayersForCommit;
+
+    /* Set to prefetch image blocks when containers are created */
+    bool gfs_prefetch;
+
+    /* Set if read replies could be spliced from the device */
+    bool gfs_splice;
+
+    /* Compression level for files in image layers, 0 if disabled */
+    int8_t gfs_compress;
+
+    /* Number of NUMA nodes */
+    uint8_t gfs_nodes;
+
+    /* NUMA node threads and memory are bound to, -1 if not bound */
+    int8_t gfs_node;
+
+    /* NUMA node of each CPU */
+    uint8_t gfs_cpuNode[LC_NUMA_CPUS_MAX];
 } __attribute__((packed));
 
+/* Maximum I/O limit accepted, in operations or MB per second */
+#define LC_QOS_LIMIT_MAX       1000000ull
+
+/* Token bucket used for limiting I/O.  Tokens are tracked in millionths */
+struct tbucket {
+
+    /* Tokens added per second, 0 if unlimited */
+    uint64_t tb_rate;
+
+    /* Tokens available, negative when in debt */
+    int64_t tb_tokens;
+
+    /* Time tokens were last added */
+    struct timeval tb_last;
+};
+
+/* I/O limits of a layer */
+struct qos {
+
+    /* Lock protecting the buckets */
+    pthread_mutex_t q_lock;
+
+    /* Limit on number of operations per second */
+    struct tbucket q_iops;
+
+    /* Limit on number of bytes per second */
+    struct tbucket q_bw;
+
+    /* Number of times requests were throttled */
+    uint64_t q_throttled;
+};
+
 /* A file system structure created for each layer */
 struct fs {
 
@@ -244,7 +445,7 @@ struct fs {
     /* Lock taken in shared mode by all file system operations.
      * This lock is taken in exclusive mode when layers are created/deleted.
      */
-    pthread_rwlock_t fs_rwlock;
+    union lslot *fs_rwlock;
 
     /* Pages for writing inodes */
     struct page *fs_inodePages;
@@ -291,6 +492,27 @@ struct fs {
     /* Dirty page count */
     uint64_t fs_dpcount;
 
+    /* Metadata pages staged in the current arena, indexed by block */
+    struct page **fs_metaPages;
+
+    /* First block of the current metadata arena */
+    uint64_t fs_metaBlock;
+
+    /* Number of blocks in the current metadata arena */
+    uint64_t fs_metaCount;
+
+    /* Number of blocks handed out from the current metadata arena */
+    uint64_t fs_metaUsed;
+
+    /* Metadata blocks written from arenas */
+    uint64_t fs_metaBlocks;
+
+    /* Number of arenas written out */
+    uint64_t fs_metaRuns;
+
+    /* Set while metadata is allocated from arenas */
+    bool fs_metaArena;
+
     /* Lock protecting dirty page list */
     pthread_mutex_t fs_plock;
 
@@ -300,9 +522,27 @@ struct fs {
     /* Lock protecting hardlinks list */
     pthread_mutex_t fs_hlock;
 
+    /* Lock protecting list of inodes with kernel cached pages */
+    pthread_mutex_t fs_klock;
+
+    /* Inodes which may have pages in kernel page cache */
+    ino_t *fs_kcached;
+
+    /* Number of inodes in fs_kcached */
+    uint64_t fs_kcount;
+
+    /* Size of fs_kcached array */
+    uint64_t fs_ksize;
+
     /* Changes in this layer compared to parent */
     struct cdir *fs_changes;
 
+    /* Directories in fs_changes hashed on inode number, while building that */
+    struct cdir **fs_chash;
+
+    /* Files in fs_changes hashed on directory and name, while building that */
+    struct cfile **fs_fhash;
+
     /* Unused extents reserved by a layer */
     struct extent *fs_extents;
 
@@ -312,6 +552,12 @@ struct fs {
     /* Extents freed in layer, including inherited from parent layer */
     struct extent *fs_fextents;
 
+    /* Extents freed from files, with pages yet to be invalidated */
+    struct extent *fs_rextents;
+
+    /* Extents released to the freed list, with pages yet to be invalidated */
+    struct extent *fs_iextents;
+
 #ifdef DEBUG
 
     /* Extents used for inodes */
@@ -345,6 +591,42 @@ struct fs {
     /* Number of writes */
     uint64_t fs_writes;
 
+    /* Bytes read from the device */
+    uint64_t fs_readBytes;
+
+    /* Bytes written to the device */
+    uint64_t fs_writeBytes;
+
+    /* Number of read requests served */
+    uint64_t fs_freads;
+
+    /* Number of write requests served */
+    uint64_t fs_fwrites;
+
+    /* Bytes read by read requests */
+    uint64_t fs_freadBytes;
+
+    /* Bytes written by write requests */
+    uint64_t fs_fwriteBytes;
+
+    /* I/O limits if any */
+    struct qos *fs_qos;
+
+    /* Maximum number of blocks the layer could use, 0 if unlimited */
+    uint64_t fs_blockLimit;
+
+    /* Maximum number of inodes the layer could have, 0 if unlimited */
+    uint64_t fs_inodeLimit;
+
+    /* Number of operations failed for exceeding limits on space */
+    uint64_t fs_quotaDenied;
+
+    /* Blocks read by containers started from this image layer */
+    struct manifest *fs_manifest;
+
+    /* Manifest of the image layer reads of this container are recorded in */
+    struct manifest *fs_mrecord;
+
     /* Inodes written */
     uint64_t fs_iwrite;
 
@@ -363,6 +645,9 @@ struct fs {
     /* Number of times layer is mounted */
     int fs_mcount;
 
+    /* Time metadata of the layer was first modified since last synced */
+    time_t fs_dirtyTime;
+
     /* Next index in inode block */
     uint8_t fs_inodeBlockIndex;
 
@@ -381,6 +666,9 @@ struct fs {
     /* Set if readOnly layer */
     bool fs_readOnly;
 
+    /* Set if pages of the layer are pinned in cache */
+    bool fs_pinned;
+
     /* No more changes in the file system */
     bool fs_frozen;
 
@@ -401,6 +689,15 @@ struct fs {
 
     /* Set when locked exclusive */
     bool fs_locked;
+
+    /* Set while layer lock is held exclusive */
+    bool fs_xlocked;
+
+    /* Set if too many files with kernel cached pages to track */
+    bool fs_koverflow;
+
+    /* Set while the layer is written to a stream */
+    bool fs_sending;
 } __attribute__((packed));
 
 /* Let the syncer know something changed and a checkpoint could be triggered */
@@ -422,11 +719,20 @@ lc_markSuperDirty(struct fs *fs) {
     }
 }
 
+/* Remember when metadata of a layer was first modified since last synced */
+static inline void
+lc_markDirtyTime(struct fs *fs) {
+    if (fs->fs_dirtyTime == 0) {
+        fs->fs_dirtyTime = time(NULL);
+    }
+}
+
 /* Mark inodes dirty */
 static inline void
 lc_markInodesDirty(struct fs *fs) {
     if (!fs->fs_inodesDirty) {
         fs->fs_inodesDirty = true;
+        lc_markDirtyTime(fs);
     }
 }
 
@@ -435,6 +741,7 @@ static inline void
 lc_markExtentsDirty(struct fs *fs) {
     if (!fs->fs_extentsDirty) {
         fs->fs_extentsDirty = true;
+        lc_markDirtyTime(fs);
     }
 }
 
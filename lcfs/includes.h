@@ -39,6 +39,8 @@
 #include <sys/sysctl.h>
 #else
 #include <sys/sysinfo.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #include <asm/ioctls.h>
 #include <linux/falloc.h>
 #endif
@@ -70,15 +72,18 @@ int ioctl_main(char *pgm, int argc, char *argv[]);
 
 void lc_memStatsEnable();
 uint64_t lc_memoryInit(uint64_t limit);
+uint64_t lc_memoryPinLimit(uint64_t limit);
+uint64_t lc_memoryPageBudget();
 void *lc_malloc(struct fs *fs, size_t size, enum lc_memTypes type);
 void lc_mallocBlockAligned(struct fs *fs, void **memptr,
                            enum lc_memTypes type);
+void lc_mallocCacheAligned(struct fs *fs, void **memptr, size_t size,
+                           enum lc_memTypes type);
 void lc_free(struct fs *fs, void *ptr, size_t size, enum lc_memTypes type);
 void lc_memMove(struct fs *fs, struct fs *to, size_t size,
                 enum lc_memTypes type);
 bool lc_checkMemoryAvailable(bool flush);
 void lc_waitMemory(struct gfs *gfs, bool wait);
-void lc_memUpdateTotal(struct fs *fs, size_t size);
 void lc_memTransferCount(struct fs *fs, struct fs *rfs, uint64_t count,
                          enum lc_memTypes type);
 void lc_memTransferExtents(struct gfs *gfs, struct fs *fs, struct fs *cfs,
@@ -87,6 +92,7 @@ void lc_checkMemStats(struct fs *fs, bool unmount);
 void lc_displayGlobalMemStats();
 void lc_displayMemStats(struct fs *fs);
 
+void lc_ioSetClass(enum lc_ioClass class);
 void lc_readBlock(struct gfs *gfs, struct fs *fs, off_t block, void *dbuf);
 void lc_readBlocks(struct gfs *gfs, struct fs *fs, struct iovec *iov,
                    int iovcnt, off_t block);
@@ -95,9 +101,20 @@ void lc_writeBlocks(struct gfs *gfs, struct fs *fs,
                     struct iovec *iov, int iovcnt, off_t block);
 void lc_updateCRC(void *buf, uint32_t *crc);
 void lc_verifyBlock(void *buf, uint32_t *crc);
+uint64_t lc_qosCharge(struct fs *fs, uint64_t ops, uint64_t bytes,
+                      bool wait);
+struct fs *lc_qosThrottle(struct fs *fs, ino_t ino, uint64_t ops,
+                          uint64_t bytes);
+void lc_qosSet(struct fs *fs, uint64_t iops, uint64_t bw);
+void lc_qosFree(struct fs *fs);
 
 int lc_deviceOpen(char *device);
+int lc_deviceOpenSplice(char *device);
+int lc_openProcessFile(pid_t pid, int fd, int flags);
 uint64_t lc_getTotalMemory();
+void lc_numaInit(struct gfs *gfs);
+int lc_numaBind(struct gfs *gfs, int node);
+int lc_numaNode(struct gfs *gfs);
 
 void lc_addExtent(struct gfs *gfs, struct fs *fs, struct extent **extents,
                   uint64_t start, uint64_t block, uint64_t count, bool sort);
@@ -112,6 +129,10 @@ void lc_inodeAddMetaExtent(struct gfs *gfs, struct fs *fs,
 void lc_blockAllocatorInit(struct gfs *gfs, struct fs *fs);
 void lc_processFreeExtents(struct gfs *gfs, struct fs *fs, bool umount);
 bool lc_hasSpace(struct gfs *gfs, bool root, bool layer);
+bool lc_quotaAvailable(struct fs *fs, bool inode);
+bool lc_quotaWrite(struct inode *inode, off_t off, size_t size,
+                   uint64_t pcount);
+bool lc_layerBlockAllocated(struct fs *fs, uint64_t block);
 void lc_addSpaceExtent(struct gfs *gfs, struct fs *fs, struct extent **extents,
                        uint64_t start, uint64_t count, bool sort);
 void lc_processLayerBlocks(struct gfs *gfs, struct fs *fs, bool unmount,
@@ -121,8 +142,16 @@ uint64_t lc_blockAllocExact(struct fs *fs, uint64_t count,
                             bool meta, bool reserve);
 void lc_blockFree(struct gfs *gfs, struct fs *fs, uint64_t block,
                   uint64_t count, bool layer, bool reuse);
+void lc_metaArenaBegin(struct fs *fs);
+void lc_metaArenaEnd(struct gfs *gfs, struct fs *fs);
+uint64_t lc_metaAlloc(struct fs *fs, uint64_t count);
+void lc_metaWriteBack(struct gfs *gfs, struct fs *fs, struct page *head,
+                      struct page *tail, uint64_t pcount);
 void lc_addFreedExtents(struct fs *fs, struct extent *extent, bool empty);
 void lc_addFreedBlocks(struct fs *fs, uint64_t block, uint64_t count);
+void lc_addReclaimExtents(struct fs *fs, struct extent *extent);
+uint64_t lc_reclaimBlocks(struct gfs *gfs, struct fs *fs, uint64_t max);
+bool lc_reclaimLayerBlocks(struct gfs *gfs, bool *busy);
 uint64_t lc_countExtents(struct gfs *gfs, struct extent *extent,
                          uint64_t *bcount);
 void lc_processFreedBlocks(struct fs *fs, bool release);
@@ -136,6 +165,8 @@ void lc_displayAllocStats(struct fs *fs);
 
 bool lc_superValid(struct super *super);
 void lc_superRead(struct gfs *gfs, struct fs *fs, uint64_t block);
+void lc_superReadTable(struct gfs *gfs, struct fs *fs);
+void lc_superFreeTable(struct gfs *gfs, struct fs *fs);
 void lc_superWrite(struct gfs *gfs, struct fs *fs, struct fs *rfs);
 void lc_superInit(struct super *super, uint64_t root, size_t size,
                   uint32_t flags, bool global);
@@ -148,8 +179,10 @@ int lc_addLayer(struct gfs *gfs, struct fs *fs, struct fs *pfs, int *inval);
 void lc_removeLayer(struct gfs *gfs, struct fs *fs, int gindex);
 void lc_addChild(struct gfs *gfs, struct fs *pfs, struct fs *fs);
 void lc_removeChild(struct fs *fs);
+pthread_rwlock_t *lc_getLayerLock(struct fs *fs);
 void lc_lock(struct fs *fs, bool exclusive);
 int lc_tryLock(struct fs *fs, bool exclusive);
+int lc_timedLock(struct fs *fs, time_t seconds);
 void lc_lockExclusive(struct fs *fs);
 void lc_unlock(struct fs *fs);
 void lc_unlockExclusive(struct fs *fs);
@@ -190,6 +223,7 @@ void lc_syncInodes(struct gfs *gfs, struct fs *fs, bool unmount);
 void lc_inodeLock(struct inode *inode, bool exclusive);
 void lc_inodeUnlock(struct inode *inode);
 void lc_invalidateInodePages(struct gfs *gfs, struct fs *fs);
+void lc_inodeKcached(struct fs *fs, struct inode *inode);
 void lc_invalidateLayerPages(struct gfs *gfs, struct fs *fs);
 void lc_moveInodes(struct fs *fs, struct fs *cfs);
 void lc_moveRootInode(struct gfs *gfs, struct fs *cfs, struct fs *fs);
@@ -198,6 +232,8 @@ void lc_switchInodeParent(struct fs *fs, ino_t root);
 void lc_swapRootInode(struct fs *fs, struct fs *cfs);
 void lc_freezeLayer(struct gfs *gfs, struct fs *fs);
 
+void lc_nameInit(struct gfs *gfs);
+void lc_nameDeinit(struct gfs *gfs);
 ino_t lc_dirLookup(struct fs *fs, struct inode *dir, const char *name);
 struct dirent *lc_getDirent(struct fs *fs, ino_t parent, ino_t ino, int *hash,
                             struct dirent *sdirent);
@@ -209,10 +245,15 @@ void lc_dirRemove(struct inode *dir, const char *name);
 void lc_dirRename(struct inode *dir, ino_t ino,
                    const char *name, const char *newname);
 void lc_dirCopy(struct inode *dir);
+void lc_dirCopyShared(struct inode *dir);
 void lc_dirRead(struct gfs *gfs, struct fs *fs, struct inode *dir, void *buf);
 void lc_dirFlush(struct gfs *gfs, struct fs *fs, struct inode *dir);
 void lc_removeTree(struct fs *fs, struct inode *dir);
 void lc_emptyDirectory(struct fs *fs, ino_t ino);
+void lc_reclaimMove(struct inode *rdir, struct inode *pdir,
+                    struct inode *dir, const char *name);
+void *lc_reclaimer(void *data);
+void lc_wakeupReclaimer(struct gfs *gfs);
 int lc_dirRemoveName(struct fs *fs, struct inode *dir,
                      const char *name, bool rmdir, void **fsp, bool layer);
 void  lc_dirConvertHashed(struct fs *fs, struct inode *dir);
@@ -221,6 +262,8 @@ void lc_dirFree(struct inode *dir);
 
 uint64_t lc_inodeEmapLookup(struct gfs *gfs, struct inode *inode,
                             uint64_t page, struct extent **extents);
+void lc_unshareEmap(struct gfs *gfs, struct fs *fs, struct inode *inode,
+                    uint64_t page);
 void lc_copyEmap(struct gfs *gfs, struct fs *fs, struct inode *inode);
 void lc_expandEmap(struct gfs *gfs, struct fs *fs, struct inode *inode);
 void lc_inodeEmapUpdate(struct gfs *gfs, struct fs *fs, struct inode *inode,
@@ -250,6 +293,15 @@ void lc_releaseReadPages(struct gfs *gfs, struct fs *fs,
                          struct page **pages, uint64_t pcount, bool nocache,
                          bool recycle);
 int lc_invalPage(struct gfs *gfs, struct fs *fs, uint64_t block);
+bool lc_pageCached(struct fs *fs, uint64_t block);
+void lc_pinPages(struct gfs *gfs, struct fs *fs, struct page **pages,
+                 uint64_t pcount);
+void lc_unpinPages(struct gfs *gfs, struct fs *fs);
+struct fs *lc_getImageLayer(struct fs *fs);
+struct manifest *lc_manifestInit(struct fs *fs, struct fs *ifs);
+void lc_manifestRecord(struct fs *fs, struct page **pages, uint32_t count);
+void lc_manifestFree(struct fs *fs, struct manifest *manifest);
+void lc_prefetch(struct gfs *gfs, struct fs *fs);
 struct page *lc_getPageNewData(struct fs *fs, uint64_t block, char *data);
 void lc_setPageBlock(struct page *page, uint64_t block);
 void lc_addPageBlockHash(struct gfs *gfs, struct fs *fs,
@@ -271,6 +323,7 @@ void lc_updateInodeSize(struct gfs *gfs, struct inode *inode,
                         bool zero, uint64_t size);
 uint64_t lc_addPages(struct inode *inode, off_t off, size_t size,
                      struct dpage *dpages, uint64_t pcount);
+uint64_t lc_newPageCount(struct inode *inode, off_t off, size_t size);
 int lc_readFile(fuse_req_t req, struct fs *fs, struct inode *inode,
                 off_t soffset, off_t endoffset, uint64_t asize,
                 struct page **pages, char **dbuf, struct fuse_bufvec *bufv);
@@ -284,18 +337,23 @@ void lc_invalidateDirtyPages(struct gfs *gfs, struct fs *fs);
 void lc_wakeupCleaner(struct gfs *gfs, bool wait);
 bool lc_flushInodeDirtyPages(struct inode *inode, uint64_t page, bool unlock,
                              bool force);
+char *lc_getDirtyPage(struct gfs *gfs, struct inode *inode, uint64_t pg,
+                      struct extent **extents);
 void lc_freePageData(struct gfs *gfs, struct fs *fs, char *data);
 void lc_freePages(struct fs *fs, struct dpage *dpages, uint64_t pcount);
 
 int lc_removeInode(struct fs *fs, struct inode *dir, ino_t ino, bool rmdir,
                    void **fsp);
 void lc_epInit(struct fuse_entry_param *ep);
+void lc_createReclaimDir(struct gfs *gfs, struct fs *fs);
 
 void lc_xattrAdd(fuse_req_t req, ino_t ino, const char *name,
                   const char *value, size_t size, int flags);
 void lc_xattrGet(fuse_req_t req, ino_t ino, const char *name, size_t size);
 void lc_xattrList(fuse_req_t req, ino_t ino, size_t size);
 void lc_xattrRemove(fuse_req_t req, ino_t ino, const char *name);
+void lc_xattrSet(struct inode *inode, const char *name, int len,
+                 const char *value, size_t size);
 bool lc_xattrCopy(struct inode *inode, struct inode *parent);
 void lc_xattrFlush(struct gfs *gfs, struct fs *fs, struct inode *inode);
 void lc_xattrRead(struct gfs *gfs, struct fs *fs, struct inode *inode,
@@ -312,6 +370,10 @@ int lc_removeRoot(struct fs *rfs, struct inode *dir, ino_t ino, bool rmdir,
                   void **fsp);
 void lc_layerIoctl(fuse_req_t req, struct gfs *gfs, const char *name,
                    enum ioctl_cmd cmd);
+void lc_layerQos(fuse_req_t req, struct gfs *gfs, const char *name);
+void lc_layerQuota(fuse_req_t req, struct gfs *gfs, const char *name);
+void lc_layerPin(fuse_req_t req, struct gfs *gfs, char *name);
+void lc_layerPrefetch(fuse_req_t req, struct gfs *gfs, const char *name);
 void lc_commitLayer(fuse_req_t req, struct fs *fs, ino_t ino, const char *name,
                     struct fuse_file_info *fi);
 
@@ -319,10 +381,14 @@ void lc_addHlink(struct fs *fs, struct inode *inode, ino_t parent);
 void lc_removeHlink(struct fs *fs, struct inode *inode, ino_t parent);
 void lc_freeHlinks(struct fs *fs);
 
+void lc_buildChangeList(struct fs *fs);
 void lc_freeChangeList(struct fs *fs);
 
 int lc_layerDiff(fuse_req_t req, const char *name, size_t size);
 
+void lc_layerSend(fuse_req_t req, struct gfs *gfs, char *name);
+void lc_layerReceive(fuse_req_t req, struct gfs *gfs, char *name);
+
 void lc_statsEnable();
 void lc_statsNew(struct fs *fs);
 void lc_statsBegin(struct timeval *start);
@@ -333,6 +399,13 @@ void lc_displayStats(struct fs *fs);
 void lc_displayStatsAll(struct gfs *gfs);
 void lc_displayGlobalStats(struct gfs *gfs);
 void lc_statsDeinit(struct fs *fs);
+void lc_mountStatsBegin(struct gfs *gfs, struct timeval *start,
+                        uint64_t *reads);
+void lc_mountStatsAdd(struct gfs *gfs, enum lc_mountPhase phase,
+                      struct timeval *start, uint64_t reads);
+void lc_mountLayerStats(struct gfs *gfs, struct fs *fs,
+                        struct timeval *start, uint64_t reads);
+void lc_displayMountStats(struct gfs *gfs);
 
 #ifdef DEBUG
 void lc_validate(struct gfs *gfs);
@@ -436,7 +436,8 @@ lc_readInodesBlock(struct gfs *gfs, struct fs *fs, uint64_t block,
                    char *buf, void *ibuf, bool lock) {
     struct inode *inode, *cinode;
     bool empty = true, reg;
-    uint64_t i, len;
+    uint64_t i, len, reads;
+    struct timeval start;
     off_t offset;
     ino_t ino;
 
@@ -477,11 +478,15 @@ lc_readInodesBlock(struct gfs *gfs, struct fs *fs, uint64_t block,
         if (reg) {
 
             /* Read emap of fragmented regular files */
+            lc_mountStatsBegin(gfs, &start, &reads);
             lc_emapRead(gfs, fs, inode, ibuf);
+            lc_mountStatsAdd(gfs, LC_MOUNT_EMAP, &start, reads);
         } else if (S_ISDIR(inode->i_mode)) {
 
             /* Read directory entries */
+            lc_mountStatsBegin(gfs, &start, &reads);
             lc_dirRead(gfs, fs, inode, ibuf);
+            lc_mountStatsAdd(gfs, LC_MOUNT_DIR, &start, reads);
         } else if (len) {
             assert(i == 0);
 
@@ -493,7 +498,11 @@ lc_readInodesBlock(struct gfs *gfs, struct fs *fs, uint64_t block,
         }
 
         /* Read extended attributes */
-        lc_xattrRead(gfs, fs, inode, ibuf);
+        if (inode->i_xattrBlock != LC_INVALID_BLOCK) {
+            lc_mountStatsBegin(gfs, &start, &reads);
+            lc_xattrRead(gfs, fs, inode, ibuf);
+            lc_mountStatsAdd(gfs, LC_MOUNT_XATTR, &start, reads);
+        }
 
         /* Set up root inode when read */
         if (inode->i_ino == fs->fs_root) {
@@ -660,7 +669,7 @@ lc_flushInodePages(struct gfs *gfs, struct fs *fs) {
     lc_fillupLastInodePage(fs);
 
     /* Allocate inode blocks */
-    block = lc_blockAllocExact(fs, fs->fs_inodePagesCount, true, true);
+    block = lc_metaAlloc(fs, fs->fs_inodePagesCount);
     if ((fs->fs_inodeBlocks == NULL) || (fs->fs_inodeIndex >= LC_IBLOCK_MAX)) {
         lc_newInodeBlock(gfs, fs);
     }
@@ -678,8 +687,8 @@ lc_flushInodePages(struct gfs *gfs, struct fs *fs) {
         count--;
     }
     assert(page == NULL);
-    lc_addPageForWriteBack(gfs, fs, fs->fs_inodePages, fs->fs_inodePagesLast,
-                           fs->fs_inodePagesCount);
+    lc_metaWriteBack(gfs, fs, fs->fs_inodePages, fs->fs_inodePagesLast,
+                     fs->fs_inodePagesCount);
     fs->fs_inodePages = NULL;
     fs->fs_inodePagesLast = NULL;
     fs->fs_inodePagesCount = 0;
@@ -930,6 +939,9 @@ lc_syncInodes(struct gfs *gfs, struct fs *fs, bool unmount) {
     lc_printf("Syncing inodes for fs %d %ld\n", fs->fs_gindex, fs->fs_root);
     lc_markSuperDirty(fs);
 
+    /* Lay out metadata written by this sync in contiguous runs */
+    lc_metaArenaBegin(fs);
+
     /* Start with new inode blocks */
     lc_releaseInodeBlock(gfs, fs);
     lc_fillupLastInodePage(fs);
@@ -1007,14 +1019,69 @@ lc_syncInodes(struct gfs *gfs, struct fs *fs, bool unmount) {
     if (!fs->fs_removed) {
         lc_flushInodeBlocks(gfs, fs);
     }
+    lc_metaArenaEnd(gfs, fs);
     if (count) {
         __sync_add_and_fetch(&fs->fs_iwrite, count);
     }
 }
 
-/* Invalidate pages in kernel page cache for the layer */
+/* Remember a regular file which may have pages in kernel page cache, so that
+ * only those are invalidated when needed.
+ */
 void
-lc_invalidateLayerPages(struct gfs *gfs, struct fs *fs) {
+lc_inodeKcached(struct fs *fs, struct inode *inode) {
+    ino_t *kcached;
+    uint64_t size;
+
+    assert(S_ISREG(inode->i_mode));
+    assert(inode->i_fs == fs);
+    if (inode->i_flags & LC_INODE_KCACHED) {
+        return;
+    }
+    pthread_mutex_lock(&fs->fs_klock);
+    if (!(inode->i_flags & LC_INODE_KCACHED)) {
+
+        /* Image layers accumulate files opened by all containers */
+        if (fs->fs_kcount == LC_KCACHE_MAX) {
+            fs->fs_koverflow = true;
+            __sync_fetch_and_or(&inode->i_flags, LC_INODE_KCACHED);
+            pthread_mutex_unlock(&fs->fs_klock);
+            return;
+        }
+        if (fs->fs_kcount == fs->fs_ksize) {
+
+            /* Grow the array */
+            size = fs->fs_ksize ? fs->fs_ksize * 2 : LC_KCACHE_MIN;
+            kcached = lc_malloc(fs, size * sizeof(ino_t), LC_MEMTYPE_KCACHE);
+            if (fs->fs_kcount) {
+                memcpy(kcached, fs->fs_kcached, fs->fs_kcount * sizeof(ino_t));
+                lc_free(fs, fs->fs_kcached, fs->fs_ksize * sizeof(ino_t),
+                        LC_MEMTYPE_KCACHE);
+            }
+            fs->fs_kcached = kcached;
+            fs->fs_ksize = size;
+        }
+        fs->fs_kcached[fs->fs_kcount++] = inode->i_ino;
+        __sync_fetch_and_or(&inode->i_flags, LC_INODE_KCACHED);
+    }
+    pthread_mutex_unlock(&fs->fs_klock);
+}
+
+/* Free the list of inodes with kernel cached pages */
+static void
+lc_freeKcached(struct fs *fs) {
+    if (fs->fs_kcached) {
+        lc_free(fs, fs->fs_kcached, fs->fs_ksize * sizeof(ino_t),
+                LC_MEMTYPE_KCACHE);
+        fs->fs_kcached = NULL;
+        fs->fs_kcount = 0;
+        fs->fs_ksize = 0;
+    }
+}
+
+/* Invalidate pages in kernel page cache of all files of the layer */
+static void
+lc_invalidateAllPages(struct gfs *gfs, struct fs *fs) {
     uint64_t i, count = 0;
     struct inode *inode;
 
@@ -1032,6 +1099,69 @@ lc_invalidateLayerPages(struct gfs *gfs, struct fs *fs) {
     }
 }
 
+/* Invalidate pages in kernel page cache for the layer.  Only files opened
+ * since the last invalidation could have pages cached in the kernel.  The
+ * kernel is notified after releasing the lock on the list.
+ */
+void
+lc_invalidateLayerPages(struct gfs *gfs, struct fs *fs) {
+    uint64_t i, count = 0, icount = 0;
+    ino_t ino, *inval = NULL;
+    struct inode *inode;
+
+    if (fs->fs_koverflow) {
+        lc_invalidateAllPages(gfs, fs);
+        return;
+    }
+    pthread_mutex_lock(&fs->fs_klock);
+    if (fs->fs_kcount) {
+        inval = lc_malloc(fs, fs->fs_kcount * sizeof(ino_t),
+                          LC_MEMTYPE_KCACHE);
+    }
+    for (i = 0; (i < fs->fs_kcount) && !fs->fs_removed; i++) {
+        ino = fs->fs_kcached[i];
+        inode = lc_lookupInodeCache(fs, ino, -1);
+        if (inode == NULL) {
+
+            /* Inode moved or freed, invalidate to be safe */
+            inval[icount++] = ino;
+            continue;
+        }
+        assert(S_ISREG(inode->i_mode));
+        if (!inode->i_private && inode->i_size) {
+            inval[icount++] = ino;
+        } else if (inode->i_size) {
+
+            /* Pages of private files are invalidated when layer is removed */
+            fs->fs_kcached[count++] = ino;
+            continue;
+        }
+
+        /* Keep tracking files still open, as those could cache more pages */
+        if (inode->i_ocount) {
+            fs->fs_kcached[count++] = ino;
+        } else {
+            __sync_fetch_and_and(&inode->i_flags, ~LC_INODE_KCACHED);
+        }
+    }
+
+    /* Keep the entries not processed if layer is being removed */
+    if (i < fs->fs_kcount) {
+        memmove(&fs->fs_kcached[count], &fs->fs_kcached[i],
+                (fs->fs_kcount - i) * sizeof(ino_t));
+        count += fs->fs_kcount - i;
+    }
+    i = fs->fs_kcount;
+    fs->fs_kcount = count;
+    pthread_mutex_unlock(&fs->fs_klock);
+    while (icount) {
+        lc_invalInodePages(gfs, inval[--icount]);
+    }
+    if (inval) {
+        lc_free(fs, inval, i * sizeof(ino_t), LC_MEMTYPE_KCACHE);
+    }
+}
+
 /* Destroy inodes belong to a file system */
 void
 lc_destroyInodes(struct fs *fs, bool remove) {
@@ -1061,7 +1191,7 @@ lc_destroyInodes(struct fs *fs, bool remove) {
 
             /* Invalidate kernel page cache when a layer is deleted */
             if (remove && !fs->fs_readOnly && inode->i_private &&
-                inode->i_size) {
+                inode->i_size && (inode->i_flags & LC_INODE_KCACHED)) {
                 lc_invalInodePages(gfs, inode->i_ino);
             }
             lc_freeInode(inode);
@@ -1084,6 +1214,7 @@ lc_destroyInodes(struct fs *fs, bool remove) {
     }
     assert(fs->fs_icount == icount);
     fs->fs_icount = 0;
+    lc_freeKcached(fs);
 }
 
 /* Clone the root directory from parent */
@@ -1177,6 +1308,11 @@ lc_cloneInode(struct fs *fs, struct inode *parent, ino_t ino, int hash,
     }
     lc_markInodeDirty(inode, flags);
 
+    /* Kernel may have cached pages of the file through the parent inode */
+    if (reg && (parent->i_flags & LC_INODE_KCACHED)) {
+        lc_inodeKcached(fs, inode);
+    }
+
     /* If shared lock is requested, take that after dropping exclusive lock */
     if (!exclusive) {
         lc_inodeUnlock(inode);
@@ -1255,7 +1391,7 @@ lc_getInode(struct fs *fs, ino_t ino, struct inode *handle,
     int hash;
 
     assert(!fs->fs_removed);
-    lc_lockOwned(&fs->fs_rwlock, false);
+    lc_lockOwned(lc_getLayerLock(fs), false);
 
     /* Check if the file handle points to the inode */
     if (handle && (handle->i_fs == fs)) {
@@ -1391,6 +1527,12 @@ lc_moveInodes(struct fs *fs, struct fs *cfs) {
             pinode = pinode->i_cnext;
             inode->i_fs = cfs;
             lc_addInode(cfs, inode, -1, false, NULL, NULL);
+            if (inode->i_flags & LC_INODE_KCACHED) {
+
+                /* Track kernel cached pages in the new layer */
+                inode->i_flags &= ~LC_INODE_KCACHED;
+                lc_inodeKcached(cfs, inode);
+            }
             lc_markInodeDirty(inode,
                               S_ISDIR(inode->i_mode) ? LC_INODE_DIRDIRTY :
                               (S_ISREG(inode->i_mode) ?
@@ -1545,7 +1687,7 @@ lc_cloneInodes(struct gfs *gfs, struct fs *fs, struct fs *pfs) {
                     lc_copyEmap(gfs, fs, inode);
                     flags = LC_INODE_EMAPDIRTY;
                 } else if (S_ISDIR(inode->i_mode)) {
-                    lc_dirCopy(inode);
+                    lc_dirCopyShared(inode);
                     flags = LC_INODE_DIRDIRTY;
                 } else {
                     flags = 0;
@@ -1559,6 +1701,15 @@ lc_cloneInodes(struct gfs *gfs, struct fs *fs, struct fs *pfs) {
                     inode->i_flags &= ~LC_INODE_SHARED;
                 }
                 lc_markInodeDirty(inode, flags);
+            } else if (inode->i_flags & LC_INODE_DCOW) {
+
+                /* Stop sharing directory entries with parent layers */
+                lc_dirCopyShared(inode);
+            } else if (S_ISREG(inode->i_mode) &&
+                       lc_inodeGetSharedEmap(inode)) {
+
+                /* Stop sharing tail of the emap list with parent layers */
+                lc_copyEmap(gfs, fs, inode);
             }
             lc_inodeUnlock(inode);
             pinode = pinode->i_cnext;
@@ -42,6 +42,12 @@ struct icache {
  */
 #define LC_DIRCACHE_SIZE 512
 
+/* Bytes allocated for the directory hash table, including a bitmap of hash
+ * lists shared with the parent layer.
+ */
+#define LC_DIRCACHE_BYTES \
+    ((LC_DIRCACHE_SIZE * sizeof(struct dirent *)) + (LC_DIRCACHE_SIZE / 8))
+
 /* Number of characters included from the name for calculating hash */
 #define LC_DIRHASH_LEN   10
 
@@ -73,12 +79,48 @@ struct dirent {
     mode_t di_mode;
 }  __attribute__((packed));
 
+/* Number of hash lists in the global table of file names */
+#define LC_NCACHE_SIZE   65536
+
+/* Number of locks protecting hash lists in the name table */
+#define LC_NCLOCK_COUNT  1024
+
+/* A file name interned in the global name table.  Directory entries of all
+ * layers point to a single copy of each distinct name.
+ */
+struct lname {
+
+    /* Next name in the hash list */
+    struct lname *n_next;
+
+    /* Number of directory entries using the name */
+    uint32_t n_refs;
+
+    /* Hash value of the whole name */
+    uint32_t n_hash;
+
+    /* Size of name */
+    uint16_t n_size;
+
+    /* Name, NUL terminated */
+    char n_name[0];
+} __attribute__((packed));
+
+/* Return the interned name a directory entry is pointing to */
+static inline struct lname *
+lc_direntName(struct dirent *dirent) {
+    return (struct lname *)(dirent->di_name - sizeof(struct lname));
+}
+
 /* Data specific for regular files */
 struct rdata {
 
     /* Extent map */
     struct extent *rd_emap;
 
+    /* First extent in the emap list still shared with parent layer */
+    struct extent *rd_semap;
+
     /* Next entry in the dirty list */
     struct inode *rd_dnext;
 
@@ -97,7 +139,7 @@ struct rdata {
     /* Count of dirty pages */
     uint32_t rd_dpcount;
 } __attribute__((packed));
-static_assert(sizeof(struct rdata) == 40, "rdata size != 40");
+static_assert(sizeof(struct rdata) == 48, "rdata size != 48");
 
 /* Data tracked for hard links */
 struct hldata {
@@ -159,6 +201,31 @@ struct ixattr {
 #define LC_INODE_SYMLINK        0x0800  /* Free symbolic link target */
 #define LC_INODE_DISK           0x1000  /* Inode flushed to disk */
 #define LC_INODE_HIDDEN         0x2000  /* Inode is hidden from child layers */
+#define LC_INODE_PINNED         0x4000  /* Pages pinned in cache */
+#define LC_INODE_DCOW           0x8000  /* Hash lists shared with parent */
+#define LC_INODE_KCACHED        0x10000 /* Pages may be in kernel page cache */
+
+/* Initial size of the list of inodes with kernel cached pages */
+#define LC_KCACHE_MIN   64
+
+/* Maximum size of the list of inodes with kernel cached pages.  All files of
+ * a layer are invalidated once the list overflows.
+ */
+#define LC_KCACHE_MAX   65536
+
+/* Number of directory entries removed in one pass of the reclaimer */
+#define LC_RECLAIM_BATCH    1024
+
+/* Blocks freed from a file at once, beyond which those are released by the
+ * reclaimer.
+ */
+#define LC_RECLAIM_DATA_MIN     (64 * 1024)
+
+/* Number of blocks released in one pass of the reclaimer */
+#define LC_RECLAIM_DATA_BATCH   (16 * 1024)
+
+/* Seconds before retrying layers which were busy while releasing blocks */
+#define LC_RECLAIM_RETRY        1
 
 /* Fake inode number used to trigger layer commit operation */
 #define LC_COMMIT_TRIGGER_INODE     LC_ROOT_INODE
@@ -264,6 +331,23 @@ lc_inodeSetEmap(struct inode *inode, struct extent *extent) {
     rdata->rd_emap = extent;
 }
 
+/* Return the first extent in the emap list shared with parent layer */
+static inline struct extent *
+lc_inodeGetSharedEmap(struct inode *inode) {
+    struct rdata *rdata = lc_inodeGetRegData(inode);
+
+    return (inode->i_flags & LC_INODE_SHARED) ? rdata->rd_emap :
+                                                rdata->rd_semap;
+}
+
+/* Set the first extent in the emap list shared with parent layer */
+static inline void
+lc_inodeSetSharedEmap(struct inode *inode, struct extent *extent) {
+    struct rdata *rdata = lc_inodeGetRegData(inode);
+
+    rdata->rd_semap = extent;
+}
+
 /* Return the size of inode page array */
 static inline uint32_t
 lc_inodeGetPageCount(struct inode *inode) {
@@ -1,49 +1,159 @@
 #include "includes.h"
 
+/* Priority class of I/Os issued by a thread.  Threads serving applications
+ * stay at the default class, background threads lower their priority.
+ */
+static __thread enum lc_ioClass lc_threadIoClass = LC_IO_READ;
+
+/* Maximum I/Os in flight in each class, 0 if unlimited */
+static const uint64_t lc_ioLimit[LC_IO_CLASS_MAX] = {
+    0, 0, LC_IO_WRITEBACK_MAX, LC_IO_BACKGROUND_MAX,
+};
+
+/* Set priority class of I/Os issued by the calling thread */
+void
+lc_ioSetClass(enum lc_ioClass class) {
+    lc_threadIoClass = class;
+}
+
+/* Check if I/Os of a higher priority class are in flight */
+static bool
+lc_ioHigherActive(struct gfs *gfs, enum lc_ioClass class) {
+    int i;
+
+    for (i = 0; i < class; i++) {
+        if (gfs->gfs_ioActive[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Admit an I/O to the device.  Writes issued on behalf of applications are
+ * never treated as reads.  Low priority I/Os wait while too many of their
+ * class are in flight, and for a bounded time while higher priority I/Os
+ * are in flight, so that reads are not stuck behind flushes and checkpoints.
+ */
+static enum lc_ioClass
+lc_ioBegin(struct gfs *gfs, bool write) {
+    enum lc_ioClass class = lc_threadIoClass;
+    bool deferred = false, expired = false;
+    struct timespec deadline;
+    struct timeval now;
+
+    if (write && (class == LC_IO_READ)) {
+        class = LC_IO_SYNC;
+    }
+    if (lc_ioLimit[class] == 0) {
+        __sync_add_and_fetch(&gfs->gfs_ioActive[class], 1);
+        return class;
+    }
+    gettimeofday(&now, NULL);
+    deadline.tv_sec = now.tv_sec;
+    deadline.tv_nsec = (now.tv_usec + (LC_IO_DEFER_TIME * 1000)) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&gfs->gfs_iolock);
+    while ((gfs->gfs_ioActive[class] >= lc_ioLimit[class]) ||
+           (!expired && lc_ioHigherActive(gfs, class))) {
+        if (gfs->gfs_ioActive[class] >= lc_ioLimit[class]) {
+
+            /* Woken up when an I/O of this class completes */
+            pthread_cond_wait(&gfs->gfs_iocond, &gfs->gfs_iolock);
+            continue;
+        }
+
+        /* Woken up when a higher priority I/O completes.  Check those again
+         * after registering as a waiter, as completions do not take the lock
+         * unless someone is waiting.
+         */
+        deferred = true;
+        __sync_add_and_fetch(&gfs->gfs_ioWaiting, 1);
+        if (lc_ioHigherActive(gfs, class) &&
+            (pthread_cond_timedwait(&gfs->gfs_iocond, &gfs->gfs_iolock,
+                                    &deadline) == ETIMEDOUT)) {
+            expired = true;
+        }
+        __sync_sub_and_fetch(&gfs->gfs_ioWaiting, 1);
+    }
+    if (deferred) {
+        gfs->gfs_ioDeferred++;
+    }
+    __sync_add_and_fetch(&gfs->gfs_ioActive[class], 1);
+    pthread_mutex_unlock(&gfs->gfs_iolock);
+    return class;
+}
+
+/* Account completion of an I/O and wake up I/Os waiting for it */
+static void
+lc_ioEnd(struct gfs *gfs, enum lc_ioClass class) {
+    __sync_sub_and_fetch(&gfs->gfs_ioActive[class], 1);
+    if (lc_ioLimit[class] || gfs->gfs_ioWaiting) {
+        pthread_mutex_lock(&gfs->gfs_iolock);
+        pthread_cond_broadcast(&gfs->gfs_iocond);
+        pthread_mutex_unlock(&gfs->gfs_iolock);
+    }
+}
+
 /* Read a file system block */
 void
 lc_readBlock(struct gfs *gfs, struct fs *fs, off_t block, void *dbuf) {
+    enum lc_ioClass class;
     size_t size;
 
     //lc_printf("Reading block %ld\n", block);
     assert((block == LC_SUPER_BLOCK) || (block < gfs->gfs_super->sb_tblocks));
+    class = lc_ioBegin(gfs, false);
     size = pread(gfs->gfs_fd, dbuf, LC_BLOCK_SIZE, block * LC_BLOCK_SIZE);
+    lc_ioEnd(gfs, class);
     assert(size == LC_BLOCK_SIZE);
     __sync_add_and_fetch(&gfs->gfs_reads, 1);
     __sync_add_and_fetch(&fs->fs_reads, 1);
+    __sync_add_and_fetch(&fs->fs_readBytes, LC_BLOCK_SIZE);
 }
 
 /* Read into a scatter gather list of buffers */
 void
 lc_readBlocks(struct gfs *gfs, struct fs *fs,
               struct iovec *iov, int iovcnt, off_t block) {
+    enum lc_ioClass class;
     size_t size;
 
     //lc_printf("lc_readBlocks: Reading %d blocks %ld\n", iovcnt, block);
     assert((block + iovcnt) < gfs->gfs_super->sb_tblocks);
+    class = lc_ioBegin(gfs, false);
     size = lc_preadv(gfs->gfs_fd, iov, iovcnt, block * LC_BLOCK_SIZE);
+    lc_ioEnd(gfs, class);
     assert(size == (iovcnt * LC_BLOCK_SIZE));
     __sync_add_and_fetch(&gfs->gfs_reads, 1);
     __sync_add_and_fetch(&fs->fs_reads, 1);
+    __sync_add_and_fetch(&fs->fs_readBytes, size);
 }
 
 /* Write a file system block */
 void
 lc_writeBlock(struct gfs *gfs, struct fs *fs, void *buf, off_t block) {
+    enum lc_ioClass class;
     size_t count;
 
     //lc_printf("lc_writeBlock: Writing block %ld\n", block);
     assert(block < gfs->gfs_super->sb_tblocks);
+    class = lc_ioBegin(gfs, true);
     count = pwrite(gfs->gfs_fd, buf, LC_BLOCK_SIZE, block * LC_BLOCK_SIZE);
+    lc_ioEnd(gfs, class);
     assert(count == LC_BLOCK_SIZE);
     __sync_add_and_fetch(&gfs->gfs_writes, 1);
     __sync_add_and_fetch(&fs->fs_writes, 1);
+    __sync_add_and_fetch(&fs->fs_writeBytes, LC_BLOCK_SIZE);
 }
 
 /* Write a scatter gather list of buffers */
 void
 lc_writeBlocks(struct gfs *gfs, struct fs *fs,
                struct iovec *iov, int iovcnt, off_t block) {
+    enum lc_ioClass class;
     ssize_t count;
 
     //lc_printf("lc_writeBlocks: Writing %d blocks %ld\n", iovcnt, block);
@@ -51,10 +161,128 @@ lc_writeBlocks(struct gfs *gfs, struct fs *fs,
     if (fs->fs_removed) {
         return;
     }
+    class = lc_ioBegin(gfs, true);
     count = lc_pwritev(gfs->gfs_fd, iov, iovcnt, block * LC_BLOCK_SIZE);
+    lc_ioEnd(gfs, class);
     assert(count == (iovcnt * LC_BLOCK_SIZE));
     __sync_add_and_fetch(&gfs->gfs_writes, 1);
     __sync_add_and_fetch(&fs->fs_writes, 1);
+    __sync_add_and_fetch(&fs->fs_writeBytes, count);
+}
+
+/* Take tokens from a bucket and return time to wait in microseconds */
+static uint64_t
+lc_tbucketCharge(struct tbucket *tb, uint64_t count, struct timeval *now) {
+    struct timeval elapsed;
+    uint64_t usec;
+
+    if (tb->tb_rate == 0) {
+        return 0;
+    }
+
+    /* Add tokens for the time elapsed, allowing a burst of one second */
+    timersub(now, &tb->tb_last, &elapsed);
+    usec = (elapsed.tv_sec >= 1) ? 1000000ull :
+           (elapsed.tv_sec < 0) ? 0 : elapsed.tv_usec;
+    tb->tb_last = *now;
+    tb->tb_tokens += usec * tb->tb_rate;
+    if (tb->tb_tokens > (tb->tb_rate * 1000000ull)) {
+        tb->tb_tokens = tb->tb_rate * 1000000ull;
+    }
+
+    /* Let the request proceed after the debt is paid off */
+    tb->tb_tokens -= count * 1000000ull;
+    return (tb->tb_tokens < 0) ? (-tb->tb_tokens / tb->tb_rate) : 0;
+}
+
+/* Charge I/O against the limits of a layer and return the time in
+ * microseconds the request needs to be delayed.  Background I/O is charged
+ * without waiting so that layer requests are throttled later instead of
+ * holding up threads working for all layers.
+ */
+uint64_t
+lc_qosCharge(struct fs *fs, uint64_t ops, uint64_t bytes, bool wait) {
+    struct qos *qos = fs->fs_qos;
+    uint64_t delay, bdelay;
+    struct timeval now;
+
+    if (likely(qos == NULL)) {
+        return 0;
+    }
+    gettimeofday(&now, NULL);
+    pthread_mutex_lock(&qos->q_lock);
+    delay = lc_tbucketCharge(&qos->q_iops, ops, &now);
+    bdelay = lc_tbucketCharge(&qos->q_bw, bytes, &now);
+    pthread_mutex_unlock(&qos->q_lock);
+    if (bdelay > delay) {
+        delay = bdelay;
+    }
+    if (wait && delay) {
+        __sync_add_and_fetch(&qos->q_throttled, 1);
+    }
+    return wait ? delay : 0;
+}
+
+/* Charge a request against the limits of the layer locked shared, waiting
+ * with the layer unlocked if the layer is over its limits, so that exclusive
+ * lockers are not held up.  Returns the layer locked again.
+ */
+struct fs *
+lc_qosThrottle(struct fs *fs, ino_t ino, uint64_t ops, uint64_t bytes) {
+    uint64_t delay = lc_qosCharge(fs, ops, bytes, true);
+
+    if (delay) {
+        lc_unlock(fs);
+        usleep(delay);
+        fs = lc_getLayerLocked(ino, false);
+    }
+    return fs;
+}
+
+/* Set I/O limits of a layer, 0 for unlimited */
+void
+lc_qosSet(struct fs *fs, uint64_t iops, uint64_t bw) {
+    struct qos *qos = fs->fs_qos;
+
+    /* Limits stay allocated until the layer is freed as I/O paths access
+     * those without locking the layer exclusive.
+     */
+    if (qos == NULL) {
+        if ((iops == 0) && (bw == 0)) {
+            return;
+        }
+        qos = lc_malloc(fs, sizeof(struct qos), LC_MEMTYPE_QOS);
+        memset(qos, 0, sizeof(struct qos));
+        pthread_mutex_init(&qos->q_lock, NULL);
+        if (!__sync_bool_compare_and_swap(&fs->fs_qos, NULL, qos)) {
+            lc_free(fs, qos, sizeof(struct qos), LC_MEMTYPE_QOS);
+            qos = fs->fs_qos;
+        }
+    }
+    pthread_mutex_lock(&qos->q_lock);
+    qos->q_iops.tb_rate = iops;
+    qos->q_iops.tb_tokens = 0;
+    qos->q_bw.tb_rate = bw;
+    qos->q_bw.tb_tokens = 0;
+    gettimeofday(&qos->q_iops.tb_last, NULL);
+    qos->q_bw.tb_last = qos->q_iops.tb_last;
+    pthread_mutex_unlock(&qos->q_lock);
+    lc_syslog(LOG_INFO, "Layer %d I/O limits %ld ops/sec %ld bytes/sec\n",
+              fs->fs_gindex, iops, bw);
+}
+
+/* Free I/O limits of a layer */
+void
+lc_qosFree(struct fs *fs) {
+    struct qos *qos = fs->fs_qos;
+
+    if (qos) {
+#ifdef LC_MUTEX_DESTROY
+        pthread_mutex_destroy(&qos->q_lock);
+#endif
+        lc_free(fs, qos, sizeof(struct qos), LC_MEMTYPE_QOS);
+        fs->fs_qos = NULL;
+    }
 }
 
 /* Calculate checksum of a block of data */
@@ -88,12 +316,17 @@ lc_checksum(char *buf) __attribute__ ((ifunc("lc_resolve_checksum")));
 /* Validate crc of the block read */
 void
 lc_verifyBlock(void *buf, uint32_t *crc) {
+    struct gfs *gfs = getfs();
     uint32_t old = *crc, new;
+    struct timeval start;
+    uint64_t reads;
 
+    lc_mountStatsBegin(gfs, &start, &reads);
     *crc = 0;
     new = lc_checksum(buf);
     assert(old == new);
     *crc = new;
+    lc_mountStatsAdd(gfs, LC_MOUNT_CRC, &start, reads);
 }
 
 /* Calculate and store new crc for a block */
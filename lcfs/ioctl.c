@@ -13,6 +13,40 @@ usage(char *pgm, char *name) {
         fprintf(stderr, "\t [-c]   - clear stats (optional)\n");
         fprintf(stderr,
                 "Specify . as id for displaying stats for all layers\n");
+    } else if (strcmp(name, "qos") == 0) {
+        fprintf(stderr, "usage: %s %s <mnt> <id> <iops> <bandwidth>\n",
+                pgm, name);
+        fprintf(stderr, "\t mnt       - mount point\n");
+        fprintf(stderr, "\t id        - layer name\n");
+        fprintf(stderr, "\t iops      - operations per second, "
+                "0 for unlimited\n");
+        fprintf(stderr, "\t bandwidth - MB per second, 0 for unlimited\n");
+    } else if (strcmp(name, "quota") == 0) {
+        fprintf(stderr, "usage: %s %s <mnt> <id> <size> <inodes>\n",
+                pgm, name);
+        fprintf(stderr, "\t mnt    - mount point\n");
+        fprintf(stderr, "\t id     - layer name\n");
+        fprintf(stderr, "\t size   - space in MB, 0 for unlimited\n");
+        fprintf(stderr, "\t inodes - number of inodes, 0 for unlimited\n");
+    } else if ((strcmp(name, "pin") == 0) || (strcmp(name, "unpin") == 0)) {
+        fprintf(stderr, "usage: %s %s <mnt> <id> [path]\n", pgm, name);
+        fprintf(stderr, "\t mnt    - mount point\n");
+        fprintf(stderr, "\t id     - layer name\n");
+        fprintf(stderr, "\t [path] - file in the layer (optional)\n");
+    } else if (strcmp(name, "prefetch") == 0) {
+        fprintf(stderr, "usage: %s %s <mnt> <id>\n", pgm, name);
+        fprintf(stderr, "\t mnt    - mount point\n");
+        fprintf(stderr, "\t id     - layer name\n");
+    } else if ((strcmp(name, "send") == 0) ||
+               (strcmp(name, "receive") == 0)) {
+        fprintf(stderr, "usage: %s %s <mnt> <id> <file>\n", pgm, name);
+        fprintf(stderr, "\t mnt    - mount point\n");
+        fprintf(stderr, "\t id     - layer name\n");
+        fprintf(stderr, "\t file   - stream file\n");
+    } else if (strcmp(name, "pinmem") == 0) {
+        fprintf(stderr, "usage: %s %s <mnt> <limit>\n", pgm, name);
+        fprintf(stderr, "\t mnt    - mount point\n");
+        fprintf(stderr, "\t limit  - memory limit in MB (default 64MB)\n");
     } else if (strcmp(name, "syncer") == 0) {
         fprintf(stderr, "usage: %s %s <mnt> <time>\n", pgm, name);
         fprintf(stderr, "\t mnt    - mount point\n");
@@ -44,12 +78,12 @@ usage(char *pgm, char *name) {
  */
 int
 ioctl_main(char *pgm, int argc, char *argv[]) {
-    char name[LAYER_NAME_MAX + 1], *dir, op;
-    int fd, err, len, value;
+    char name[LAYER_NAME_MAX + 1], path[PATH_MAX], *dir, op;
+    int fd, sfd, err, len, value;
     enum ioctl_cmd cmd;
     struct stat st;
 
-    if ((argc != 2) && (argc != 3) && (argc != 4)) {
+    if ((argc < 2) || (argc > 5)) {
         usage(pgm, argv[0]);
     }
     if (stat(argv[1], &st)) {
@@ -75,7 +109,7 @@ ioctl_main(char *pgm, int argc, char *argv[]) {
             close(fd);
             usage(pgm, argv[0]);
         }
-        if ((argc == 4) && strcmp(argv[3], "-c")) {
+        if ((argc > 4) || ((argc == 4) && strcmp(argv[3], "-c"))) {
             close(fd);
             usage(pgm, argv[0]);
         }
@@ -85,6 +119,91 @@ ioctl_main(char *pgm, int argc, char *argv[]) {
         name[len] = 0;
         cmd = (argc == 3) ? LAYER_STAT : CLEAR_STAT;
         err = ioctl(fd, _IOW(0, cmd, name), name);
+    } else if (strcmp(argv[0], "qos") == 0) {
+        if ((argc != 5) || (atoll(argv[3]) < 0) || (atoll(argv[4]) < 0)) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        len = snprintf(name, sizeof(name), "%lld %lld %s",
+                       atoll(argv[3]), atoll(argv[4]), argv[2]);
+        if (len >= sizeof(name)) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        err = ioctl(fd, _IOW(0, LAYER_QOS, name), name);
+    } else if (strcmp(argv[0], "quota") == 0) {
+        if ((argc != 5) || (atoll(argv[3]) < 0) || (atoll(argv[4]) < 0)) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        len = snprintf(name, sizeof(name), "%lld %lld %s",
+                       atoll(argv[3]), atoll(argv[4]), argv[2]);
+        if (len >= sizeof(name)) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        err = ioctl(fd, _IOW(0, LAYER_QUOTA, name), name);
+    } else if ((strcmp(argv[0], "pin") == 0) ||
+               (strcmp(argv[0], "unpin") == 0)) {
+        if ((argc != 3) && (argc != 4)) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        op = (strcmp(argv[0], "pin") == 0) ? 1 : 0;
+        if (argc == 3) {
+            len = snprintf(path, sizeof(path), "%d %s", op, argv[2]);
+        } else {
+            len = snprintf(path, sizeof(path), "%d %s %s", op, argv[2],
+                           argv[3]);
+        }
+        if (len >= sizeof(path)) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        err = ioctl(fd, _IOW(0, LAYER_PIN, path), path);
+    } else if (strcmp(argv[0], "prefetch") == 0) {
+        if (argc != 3) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        len = strlen(argv[2]);
+        if (len >= sizeof(name)) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        memcpy(name, argv[2], len);
+        name[len] = 0;
+        err = ioctl(fd, _IOW(0, LAYER_PREFETCH, name), name);
+    } else if ((strcmp(argv[0], "send") == 0) ||
+               (strcmp(argv[0], "receive") == 0)) {
+        if (argc != 4) {
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+
+        /* Stream file is opened here and the daemon opens the same file
+         * through the descriptor, with the access the file is opened for.
+         */
+        cmd = (strcmp(argv[0], "send") == 0) ? LAYER_SEND : LAYER_RECEIVE;
+        sfd = (cmd == LAYER_SEND) ?
+              open(argv[3], O_WRONLY | O_CREAT | O_TRUNC, 0600) :
+              open(argv[3], O_RDONLY);
+        if (sfd < 0) {
+            perror("open");
+            fprintf(stderr, "Failed to open %s\n", argv[3]);
+            close(fd);
+            exit(errno);
+        }
+        len = snprintf(path, sizeof(path), "%s %d", argv[2], sfd);
+        if (len >= sizeof(path)) {
+            close(sfd);
+            close(fd);
+            usage(pgm, argv[0]);
+        }
+        err = ioctl(fd, _IOW(0, cmd, path), path);
+        value = errno;
+        close(sfd);
+        errno = value;
     } else if (strcmp(argv[0], "flush") == 0) {
         if (argc != 2) {
             close(fd);
@@ -108,7 +227,7 @@ ioctl_main(char *pgm, int argc, char *argv[]) {
                || (strcmp(argv[0], "profile") == 0)
 #endif
                ) {
-        if (argc < 3) {
+        if (argc != 3) {
             close(fd);
             usage(pgm, argv[0]);
         }
@@ -140,6 +259,8 @@ ioctl_main(char *pgm, int argc, char *argv[]) {
             err = ioctl(fd, _IOW(0, SYNCER_TIME, int), argv[2]);
         } else if (value && (strcmp(argv[0], "pcache") == 0)) {
             err = ioctl(fd, _IOW(0, DCACHE_MEMORY, int), argv[2]);
+        } else if (strcmp(argv[0], "pinmem") == 0) {
+            err = ioctl(fd, _IOW(0, DCACHE_PIN_MEMORY, int), argv[2]);
         } else {
             close(fd);
             usage(pgm, argv[0]);
@@ -59,7 +59,8 @@ lc_invalidateFirstLayer(struct gfs *gfs, struct fs *pfs, int gindex) {
 void
 lc_createLayer(fuse_req_t req, struct gfs *gfs, const char *name,
                const char *parent, size_t size, bool rw) {
-    struct fs *fs = NULL, *pfs = NULL, *rfs = NULL;
+    struct fs *fs = NULL, *pfs = NULL, *rfs = NULL, *ifs = NULL;
+    struct manifest *manifest = NULL;
     ino_t root, pinum = 0;
     struct timeval start;
     char pname[size + 1];
@@ -140,6 +141,16 @@ lc_createLayer(fuse_req_t req, struct gfs *gfs, const char *name,
         assert(!(fs->fs_super->sb_flags & LC_SUPER_ZOMBIE));
         assert(pfs->fs_root == lc_getInodeHandle(pinum));
         lc_linkParent(fs, pfs);
+
+        /* Record reads of a new container or prefetch what other containers
+         * read from the image before.
+         */
+        if (rw && !init) {
+            ifs = lc_getImageLayer(pfs);
+            if (ifs) {
+                manifest = lc_manifestInit(fs, ifs);
+            }
+        }
     }
 
     /* Add this file system to global list of file systems */
@@ -206,6 +217,11 @@ out:
         if (!err && inval) {
             lc_invalidateFirstLayer(gfs, pfs, inval);
         }
+
+        /* Image layer stays while the parent layer is locked */
+        if (!err && manifest && gfs->gfs_prefetch) {
+            lc_prefetch(gfs, ifs);
+        }
         lc_unlock(pfs);
     }
     lc_unlock(rfs);
@@ -504,11 +520,233 @@ lc_layerIoctl(fuse_req_t req, struct gfs *gfs, const char *name,
     lc_unlock(rfs);
 }
 
+/* Set space limits of a layer.  Limits are specified as
+ * "<MB> <inodes> <name>", with 0 for no limit.
+ */
+void
+lc_layerQuota(fuse_req_t req, struct gfs *gfs, const char *name) {
+    uint64_t size, inodes;
+    struct fs *fs, *rfs;
+    char *layer;
+    ino_t root;
+    int err = 0;
+
+    size = strtoull(name, &layer, 10);
+    inodes = strtoull(layer, &layer, 10);
+    while (*layer == ' ') {
+        layer++;
+    }
+    if ((*layer == 0) ||
+        (size > (gfs->gfs_super->sb_tblocks * LC_BLOCK_SIZE) >> 20)) {
+        lc_reportError(__func__, __LINE__, 0, EINVAL);
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    rfs = lc_getLayerLocked(LC_ROOT_INODE, false);
+    root = lc_getRootIno(rfs, layer, NULL, true);
+    if (root == LC_INVALID_INODE) {
+        err = ENOENT;
+    } else {
+
+        /* Limits are stored in the superblock to survive remounts */
+        fs = lc_getLayerLocked(root, false);
+        fs->fs_blockLimit = (size << 20) / LC_BLOCK_SIZE;
+        fs->fs_inodeLimit = inodes;
+        fs->fs_super->sb_blockLimit = fs->fs_blockLimit;
+        fs->fs_super->sb_inodeLimit = fs->fs_inodeLimit;
+        lc_markSuperDirty(fs);
+        lc_unlock(fs);
+    }
+    lc_unlock(rfs);
+    if (err) {
+        fuse_reply_err(req, err);
+    } else {
+        fuse_reply_ioctl(req, 0, NULL, 0);
+        lc_layerChanged(gfs, false, false);
+    }
+}
+
+/* Set I/O limits of a layer.  Limits are specified as "<iops> <MB/s> <name>"
+ */
+void
+lc_layerQos(fuse_req_t req, struct gfs *gfs, const char *name) {
+    uint64_t iops, bw;
+    struct fs *fs, *rfs;
+    char *layer;
+    ino_t root;
+    int err = 0;
+
+    iops = strtoull(name, &layer, 10);
+    bw = strtoull(layer, &layer, 10);
+    while (*layer == ' ') {
+        layer++;
+    }
+    if ((*layer == 0) || (iops > LC_QOS_LIMIT_MAX) ||
+        (bw > LC_QOS_LIMIT_MAX)) {
+        lc_reportError(__func__, __LINE__, 0, EINVAL);
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    rfs = lc_getLayerLocked(LC_ROOT_INODE, false);
+    root = lc_getRootIno(rfs, layer, NULL, true);
+    if (root == LC_INVALID_INODE) {
+        err = ENOENT;
+    } else {
+        fs = lc_getLayerLocked(root, false);
+        lc_qosSet(fs, iops, bw * 1024ull * 1024ull);
+        lc_unlock(fs);
+    }
+    lc_unlock(rfs);
+    if (err) {
+        fuse_reply_err(req, err);
+    } else {
+        fuse_reply_ioctl(req, 0, NULL, 0);
+    }
+}
+
+/* Pin or unpin pages of a layer or a file in a layer in the page cache.
+ * Request is in the form "<op> <layer> [<path>]", with op 1 for pinning and 0
+ * for unpinning, and path relative to the root of the layer.
+ */
+void
+lc_layerPin(fuse_req_t req, struct gfs *gfs, char *name) {
+    char *layer, *path, *next;
+    struct inode *inode;
+    struct fs *fs, *rfs;
+    ino_t root, ino;
+    int err = 0;
+    uint64_t op;
+    bool file;
+
+    op = strtoull(name, &layer, 10);
+    while (*layer == ' ') {
+        layer++;
+    }
+    path = strchr(layer, ' ');
+    if (path) {
+        *path = 0;
+        path++;
+    }
+    file = (path != NULL);
+    if ((*layer == 0) || (op > 1)) {
+        lc_reportError(__func__, __LINE__, 0, EINVAL);
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    rfs = lc_getLayerLocked(LC_ROOT_INODE, false);
+    root = lc_getRootIno(rfs, layer, NULL, true);
+    if (root == LC_INVALID_INODE) {
+        lc_unlock(rfs);
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    fs = lc_getLayerLocked(root, false);
+    lc_unlock(rfs);
+    if (!file) {
+        fs->fs_pinned = op;
+    } else {
+
+        /* Lookup the file one component at a time */
+        ino = root;
+        while (path && !err) {
+            next = strchr(path, '/');
+            if (next) {
+                *next = 0;
+                next++;
+            }
+            if (*path) {
+                inode = lc_getInode(fs, ino, NULL, false, false);
+                if (inode == NULL) {
+                    err = ENOENT;
+                    break;
+                }
+                if (S_ISDIR(inode->i_mode)) {
+                    ino = lc_dirLookup(fs, inode, path);
+                    if (ino == LC_INVALID_INODE) {
+                        err = ENOENT;
+                    }
+                } else {
+                    err = ENOTDIR;
+                }
+                lc_inodeUnlock(inode);
+            }
+            path = next;
+        }
+        if (!err) {
+
+            /* Files inherited by a read-write layer are copied, so that
+             * pinning those does not affect other layers sharing the parent.
+             */
+            inode = lc_getInode(fs, ino, NULL, !fs->fs_frozen, true);
+            if (inode == NULL) {
+                err = ENOENT;
+            } else if (!S_ISREG(inode->i_mode) || (inode->i_fs != fs)) {
+                err = EINVAL;
+            } else if (op) {
+                inode->i_flags |= LC_INODE_PINNED;
+            } else {
+                inode->i_flags &= ~LC_INODE_PINNED;
+            }
+            if (inode) {
+                lc_inodeUnlock(inode);
+            }
+        }
+    }
+
+    /* Pages pinned already are pinned again if still needed */
+    if (!err && !op) {
+        lc_unpinPages(gfs, fs);
+    }
+    lc_unlock(fs);
+    if (err) {
+        lc_reportError(__func__, __LINE__, 0, err);
+        fuse_reply_err(req, err);
+    } else {
+        lc_syslog(LOG_INFO, "%s %s in cache\n", op ? "Pinned" : "Unpinned",
+                  file ? "file" : "layer");
+        fuse_reply_ioctl(req, 0, NULL, 0);
+    }
+}
+
+/* Prefetch blocks of the image layer a layer is created from, recorded when
+ * a container was started from the image before.
+ */
+void
+lc_layerPrefetch(fuse_req_t req, struct gfs *gfs, const char *name) {
+    struct manifest *manifest = NULL;
+    struct fs *fs, *rfs, *ifs;
+    ino_t root;
+
+    rfs = lc_getLayerLocked(LC_ROOT_INODE, false);
+    root = lc_getRootIno(rfs, name, NULL, true);
+    if (root == LC_INVALID_INODE) {
+        lc_unlock(rfs);
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    fs = lc_getLayerLocked(root, false);
+    lc_unlock(rfs);
+    ifs = lc_getImageLayer(fs);
+    if (ifs && ifs->fs_manifest && (time(NULL) >= ifs->fs_manifest->m_end)) {
+        manifest = ifs->fs_manifest;
+    }
+    if (manifest == NULL) {
+        lc_unlock(fs);
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    /* Image layer stays while the layer is locked */
+    lc_prefetch(gfs, ifs);
+    lc_unlock(fs);
+    fuse_reply_ioctl(req, 0, NULL, 0);
+}
+
 /* Promote a read-write layer to read-only layer */
 void
 lc_commitLayer(fuse_req_t req, struct fs *fs, ino_t ino, const char *layer,
                struct fuse_file_info *fi) {
-    struct fs *rfs, *cfs, *pfs, *tfs, *bfs = NULL;
+    struct fs *rfs, *cfs, *pfs, *tfs, *bfs = NULL, *ifs = fs->fs_parent;
     int gindex = fs->fs_gindex, newgindex;
     struct extent *extents = NULL;
     struct gfs *gfs = fs->fs_gfs;
@@ -533,16 +771,14 @@ lc_commitLayer(fuse_req_t req, struct fs *fs, ino_t ino, const char *layer,
     newgindex = cfs->fs_gindex;
     pfs = lc_getLayerLocked(lc_setHandle(cfs->fs_parent->fs_gindex,
                                          cfs->fs_parent->fs_root), true);
-    fs = lc_getLayerLocked(ino, true);
-    assert(!fs->fs_removed);
 
-    /* Respond after locking all layers */
-    fuse_reply_create(req, &e, fi);
-    assert(fs->fs_aextents == NULL);
-
-    /* Clone inodes shared with parent layers */
+    /* Clone inodes shared with parent layers.  This and cloning root
+     * directories do not involve the layer commit is issued on, so those are
+     * done before locking that layer.  That layer is then blocked only while
+     * the inodes changed in it are moved over.
+     */
     tfs = pfs;
-    while (tfs != fs->fs_parent) {
+    while (tfs != ifs) {
         lc_cloneInodes(gfs, cfs, tfs);
         tfs = tfs->fs_parent;
     }
@@ -550,15 +786,23 @@ lc_commitLayer(fuse_req_t req, struct fs *fs, ino_t ino, const char *layer,
     /* Clone root directories */
     dir = cfs->fs_rootInode;
     if (dir->i_flags & LC_INODE_SHARED) {
-        lc_dirCopy(dir);
+        lc_dirCopyShared(dir);
         dir = pfs->fs_rootInode;
     } else {
+        lc_dirCopyShared(dir);
         dir = pfs->fs_rootInode;
         lc_dirFree(dir);
         lc_cloneRootDir(cfs->fs_rootInode, dir);
-        lc_dirCopy(dir);
+        lc_dirCopyShared(dir);
     }
     assert(!(dir->i_flags & LC_INODE_SHARED));
+    fs = lc_getLayerLocked(ino, true);
+    assert(!fs->fs_removed);
+    assert(fs->fs_parent == ifs);
+
+    /* Respond after locking all layers */
+    fuse_reply_create(req, &e, fi);
+    assert(fs->fs_aextents == NULL);
 
     /* Move inodes from the new layer to the layer being committed.
      * There could be open handles on inodes.
@@ -52,6 +52,9 @@
 /* Magic number stored in emap blocks */
 #define LC_EMAP_MAGIC  0x6452FABC
 
+/* Magic number stored at the beginning of compressed files */
+#define LC_COMPRESS_MAGIC  0x5A46434C
+
 /* Magic number stored in directory blocks */
 #define LC_DIR_MAGIC   0x7FBD853A
 
@@ -73,6 +76,9 @@
 /* Directory in which temporary data placed */
 #define LC_LAYER_TMP_DIR    "tmp"
 
+/* Directory holding removed directory trees pending reclaim */
+#define LC_LAYER_RECLAIM_DIR ".lcfs-reclaim"
+
 /* local-kv.db file in root layer */
 #define LC_LAYER_LOCAL_KV_DB "local-kv.db"
 #define LC_PLUGIN_FILENAME   "lcfs_plugin"
@@ -179,8 +185,22 @@ struct super {
     /* pcache limit */
     uint32_t sb_pcache;
 
+    /* First block of the contiguous table of layer superblocks, 0 on devices
+     * formatted before the table was tracked.
+     */
+    uint64_t sb_layerBlock;
+
+    /* Number of layer superblocks in the table */
+    uint64_t sb_layerCount;
+
+    /* Limit on blocks used by the layer, 0 if unlimited */
+    uint64_t sb_blockLimit;
+
+    /* Limit on inodes used by the layer, 0 if unlimited */
+    uint64_t sb_inodeLimit;
+
     /* Padding for filling up a block */
-    uint8_t  sb_pad[LC_BLOCK_SIZE - 216];
+    uint8_t  sb_pad[LC_BLOCK_SIZE - 248];
 } __attribute__((packed));
 static_assert(sizeof(struct super) == LC_BLOCK_SIZE, "superblock size != LC_BLOCK_SIZE");
 
@@ -235,7 +255,10 @@ struct dinode {
     gid_t di_gid;
 
     /* Parent inode number of singly linked inodes */
-    uint64_t di_parent:63;
+    uint64_t di_parent:62;
+
+    /* Set if data is stored compressed */
+    uint64_t di_compressed:1;
 
     /* Set if blocks are newly allocated and not inherited */
     uint64_t di_private:1;
@@ -350,6 +373,32 @@ struct emapBlock {
 };
 static_assert(sizeof(struct emapBlock) == LC_BLOCK_SIZE, "emapBlock size != LC_BLOCK_SIZE");
 
+/* Number of pages compressed together */
+#define LC_COMPRESS_CLUSTER     16
+
+/* Maximum number of pages in a compressed file */
+#define LC_COMPRESS_MAX_PAGES   4096
+
+/* Header at the beginning of a compressed file, followed by compressed
+ * clusters of pages.
+ */
+struct dzfile {
+    /* Magic number */
+    uint32_t dz_magic;
+
+    /* Number of pages in the file */
+    uint32_t dz_pages;
+
+    /* Byte offset of each cluster from the start of the file, with an extra
+     * entry for the end of the last cluster.
+     */
+    uint32_t dz_offset[];
+} __attribute__((packed));
+static_assert((sizeof(struct dzfile) +
+               (((LC_COMPRESS_MAX_PAGES / LC_COMPRESS_CLUSTER) + 1) *
+                sizeof(uint32_t))) < LC_BLOCK_SIZE,
+              "dzfile size >= LC_BLOCK_SIZE");
+
 /* Directory entry structure */
 struct ddirent {
 
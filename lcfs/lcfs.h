@@ -18,6 +18,13 @@ enum ioctl_cmd {
     LCFS_GROW = 113,                /* Grow file system */
     LCFS_PROFILE = 114,             /* Enable/disable profiling */
     LCFS_VERBOSE = 115,             /* Enable/disable verbose mode */
+    LAYER_QOS = 116,                /* Set I/O limits of a layer */
+    LAYER_PIN = 117,                /* Pin/unpin a layer or file in cache */
+    DCACHE_PIN_MEMORY = 118,        /* Adjust memory for pinned pages */
+    LAYER_PREFETCH = 119,           /* Prefetch blocks of an image layer */
+    LAYER_SEND = 120,               /* Write a layer to a stream file */
+    LAYER_RECEIVE = 121,            /* Populate a layer from a stream file */
+    LAYER_QUOTA = 122,              /* Set space limits of a layer */
 };
 
 /* Prefix of fake file name used to trigger layer commit */
@@ -36,4 +43,108 @@ struct pchange {
     char ch_path[0];
 } __attribute__((packed));
 
+/* Magic number of a layer stream */
+#define LC_SEND_MAGIC       0x4C435353
+
+/* Version of the layer stream format */
+#define LC_SEND_VERSION     1
+
+/* Maximum number of blocks in a data extent of a layer stream */
+#define LC_SEND_EXTENT_MAX  256
+
+/* Header of a layer stream */
+struct sheader {
+
+    /* Magic number */
+    uint32_t sh_magic;
+
+    /* Version of the stream format */
+    uint32_t sh_version;
+} __attribute__((packed));
+
+/* Type of a record in a layer stream */
+enum lc_sendType {
+
+    /* Directory created or modified */
+    LC_SEND_DIRECTORY = 1,
+
+    /* File, symbolic link or special file created or modified */
+    LC_SEND_FILE = 2,
+
+    /* Hard link to a file sent before */
+    LC_SEND_LINK = 3,
+
+    /* Removed file or directory */
+    LC_SEND_WHITEOUT = 4,
+
+    /* End of the stream */
+    LC_SEND_END = 5,
+};
+
+/* Record in a layer stream.  Followed by the path, target of a symbolic link
+ * or path of the file a hard link points to, extended attributes, and data
+ * extents of a regular file terminated by an empty extent.
+ */
+struct srecord {
+
+    /* Type of record */
+    uint8_t sr_type;
+
+    /* Length of path */
+    uint16_t sr_len;
+
+    /* Length of link target */
+    uint16_t sr_tlen;
+
+    /* Count of extended attributes */
+    uint16_t sr_xcount;
+
+    /* File mode and permissions */
+    uint32_t sr_mode;
+
+    /* User id */
+    uint32_t sr_uid;
+
+    /* Group id */
+    uint32_t sr_gid;
+
+    /* Device id */
+    uint64_t sr_rdev;
+
+    /* Size of the file */
+    uint64_t sr_size;
+
+    /* Modification time */
+    uint64_t sr_mtime;
+
+    /* Change time */
+    uint64_t sr_ctime;
+
+    /* Nanoseconds of modification time */
+    uint32_t sr_mtimeNsec;
+
+    /* Nanoseconds of change time */
+    uint32_t sr_ctimeNsec;
+} __attribute__((packed));
+
+/* Extended attribute in a layer stream, followed by name and value */
+struct sxattr {
+
+    /* Length of name */
+    uint16_t sx_len;
+
+    /* Size of value */
+    uint32_t sx_size;
+} __attribute__((packed));
+
+/* Data extent in a layer stream, followed by blocks of data */
+struct sextent {
+
+    /* First page of the extent */
+    uint64_t se_page;
+
+    /* Number of blocks in the extent */
+    uint32_t se_count;
+} __attribute__((packed));
+
 #endif
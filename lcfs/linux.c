@@ -6,6 +6,47 @@ lc_deviceOpen(char *device) {
     return open(device, O_RDWR | O_DIRECT | O_EXCL | O_NOATIME, 0);
 }
 
+/* Open a device for splicing data to read replies.  Buffered I/O is needed,
+ * since splicing and the fallback of copying through a user buffer have no
+ * alignment guarantees.  Direct writes through the other descriptor
+ * invalidate any cached data.
+ */
+int
+lc_deviceOpenSplice(char *device) {
+    return open(device, O_RDONLY | O_NOATIME, 0);
+}
+
+/* Open a file a process has open as a descriptor, if the process has that
+ * open for the access requested.
+ */
+int
+lc_openProcessFile(pid_t pid, int fd, int flags) {
+    unsigned int fflags, access = O_ACCMODE;
+    char path[64], *line = NULL;
+    size_t len = 0;
+    FILE *fp;
+
+    sprintf(path, "/proc/%d/fdinfo/%d", pid, fd);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    while (getline(&line, &len, fp) > 0) {
+        if (sscanf(line, "flags: %o", &fflags) == 1) {
+            access = fflags & O_ACCMODE;
+            break;
+        }
+    }
+    free(line);
+    fclose(fp);
+    if ((access != flags) && (access != O_RDWR)) {
+        errno = EACCES;
+        return -1;
+    }
+    sprintf(path, "/proc/%d/fd/%d", pid, fd);
+    return open(path, flags, 0);
+}
+
 /* Find out how much memory the system has */
 uint64_t
 lc_getTotalMemory() {
@@ -14,3 +55,97 @@ lc_getTotalMemory() {
     sysinfo(&info);
     return info.totalram;
 }
+
+/* Memory policy mode, from linux/mempolicy.h */
+#define LC_MPOL_PREFERRED  1
+
+/* Find the NUMA node of every CPU from sysfs */
+void
+lc_numaInit(struct gfs *gfs) {
+    int node, start, end, cpu, count;
+    char path[64], *list;
+    size_t len = 0;
+    FILE *fp;
+
+    gfs->gfs_nodes = 1;
+    gfs->gfs_node = -1;
+    list = NULL;
+    for (node = 0; node < LC_NUMA_NODES_MAX; node++) {
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+        fp = fopen(path, "r");
+        if (fp == NULL) {
+            break;
+        }
+
+        /* List is of the form "0-3,8-11" */
+        if (getline(&list, &len, fp) > 0) {
+            for (start = 0; list[start] && (list[start] != '\n'); ) {
+                count = sscanf(&list[start], "%d-%d", &cpu, &end);
+                if (count < 1) {
+                    break;
+                }
+                if (count == 1) {
+                    end = cpu;
+                }
+                for (; (cpu <= end) && (cpu < LC_NUMA_CPUS_MAX); cpu++) {
+                    gfs->gfs_cpuNode[cpu] = node;
+                }
+                while (list[start] && (list[start] != ',') &&
+                       (list[start] != '\n')) {
+                    start++;
+                }
+                if (list[start] == ',') {
+                    start++;
+                }
+            }
+        }
+        fclose(fp);
+    }
+    free(list);
+    if (node > 1) {
+        gfs->gfs_nodes = node;
+        lc_syslog(LOG_INFO, "%d NUMA nodes\n", node);
+    }
+}
+
+/* Run this thread and threads created from now on on CPUs of a NUMA node,
+ * and allocate memory from that node.  Memory comes from other nodes once the
+ * node runs out of free memory.  The memory policy system call is used
+ * directly since libnuma is not linked in.
+ */
+int
+lc_numaBind(struct gfs *gfs, int node) {
+    unsigned long mask;
+    cpu_set_t set;
+    int cpu, err;
+
+    if ((node < 0) || (node >= gfs->gfs_nodes)) {
+        return EINVAL;
+    }
+    CPU_ZERO(&set);
+    for (cpu = 0; cpu < LC_NUMA_CPUS_MAX; cpu++) {
+        if (gfs->gfs_cpuNode[cpu] == node) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        return err;
+    }
+    mask = 1ul << node;
+    if (syscall(SYS_set_mempolicy, LC_MPOL_PREFERRED, &mask,
+                LC_NUMA_NODES_MAX + 1)) {
+        return errno;
+    }
+    gfs->gfs_node = node;
+    return 0;
+}
+
+/* Return the NUMA node of the CPU the thread is running on */
+int
+lc_numaNode(struct gfs *gfs) {
+    int cpu = sched_getcpu();
+
+    return ((cpu >= 0) && (cpu < LC_NUMA_CPUS_MAX)) ?
+           gfs->gfs_cpuNode[cpu] : 0;
+}
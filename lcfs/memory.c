@@ -58,6 +58,12 @@ static const char *mrequests[] = {
     "SYMLINK",
     "RWLOCK",
     "STATS",
+    "QOS",
+    "MANIFEST",
+    "KCACHE",
+    "ZBUF",
+    "NAME",
+    "DIFF",
 };
 
 /* Initialize limit based on available memory */
@@ -82,6 +88,22 @@ lc_memoryInit(uint64_t limit) {
     return limit;
 }
 
+/* Return memory allowed for pinned pages, limited to a portion of memory for
+ * data pages.
+ */
+uint64_t
+lc_memoryPinLimit(uint64_t limit) {
+    uint64_t max = (lc_mem.m_purgeMemory * LC_PIN_MEMORY_MAX) / 100;
+
+    return (limit > max) ? max : limit;
+}
+
+/* Return number of pages which could be cached by all layer trees */
+uint64_t
+lc_memoryPageBudget() {
+    return lc_mem.m_purgeMemory / LC_BLOCK_SIZE;
+}
+
 /* Check memory usage for data pages is under limit or not */
 bool
 lc_checkMemoryAvailable(bool flush) {
@@ -127,8 +149,11 @@ lc_memStatsUpdate(struct fs *fs, size_t size, bool alloc,
                         1, true);
     } else {
 
-        /* Global stats */
-        assert(type == LC_MEMTYPE_GFS);
+        /* Global stats, including names shared by all layers and buffers
+         * filled by threads scanning a layer in parallel.
+         */
+        assert((type == LC_MEMTYPE_GFS) || (type == LC_MEMTYPE_NAME) ||
+               (type == LC_MEMTYPE_DIFF));
         if (alloc) {
             __sync_add_and_fetch(&lc_mem.m_globalMemory, size);
             __sync_add_and_fetch(&lc_mem.m_globalMalloc, 1);
@@ -140,15 +165,6 @@ lc_memStatsUpdate(struct fs *fs, size_t size, bool alloc,
     }
 }
 
-/* Substract total memory usage */
-void
-lc_memUpdateTotal(struct fs *fs, size_t size) {
-    if (!memStatsEnabled) {
-        return;
-    }
-    __sync_fetch_and_sub(&fs->fs_memory, size);
-}
-
 /* Transfer some memory from a layer to another layer */
 void
 lc_memTransferCount(struct fs *fs, struct fs *rfs, uint64_t count,
@@ -199,6 +215,16 @@ lc_mallocBlockAligned(struct fs *fs, void **memptr, enum lc_memTypes type) {
     lc_memStatsUpdate(fs, LC_BLOCK_SIZE, true, type);
 }
 
+/* Allocate memory aligned to a CPU cache line */
+void
+lc_mallocCacheAligned(struct fs *fs, void **memptr, size_t size,
+                      enum lc_memTypes type) {
+    int err = posix_memalign(memptr, LC_CACHELINE_SIZE, size);
+
+    assert(err == 0);
+    lc_memStatsUpdate(fs, size, true, type);
+}
+
 /* Release previously allocated memory */
 void
 lc_free(struct fs *fs, void *ptr, size_t size, enum lc_memTypes type) {
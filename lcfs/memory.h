@@ -29,7 +29,13 @@ enum lc_memTypes {
     LC_MEMTYPE_SYMLINK = 23,        /* Symbolic link */
     LC_MEMTYPE_IRWLOCK = 24,        /* Inode lock */
     LC_MEMTYPE_STATS = 25,          /* Request stats */
-    LC_MEMTYPE_MAX = 26,
+    LC_MEMTYPE_QOS = 26,            /* I/O limits */
+    LC_MEMTYPE_MANIFEST = 27,       /* Access manifest */
+    LC_MEMTYPE_KCACHE = 28,         /* Inodes with kernel cached pages */
+    LC_MEMTYPE_ZBUF = 29,           /* Buffers for compressing data */
+    LC_MEMTYPE_NAME = 30,           /* Interned file names */
+    LC_MEMTYPE_DIFF = 31,           /* Buffers for building layer diff */
+    LC_MEMTYPE_MAX = 32,
 };
 
 #endif
@@ -167,6 +167,19 @@ lc_removeDirtyInode(struct fs *fs, struct inode *inode, struct inode *prev) {
     return next;
 }
 
+/* Invalidate pages of a compressed file starting at the block */
+static void
+lc_invalCompressedPages(struct gfs *gfs, struct fs *fs, uint64_t block) {
+    uint64_t pg, count = 0;
+
+    for (pg = 0; pg < LC_COMPRESS_MAX_PAGES; pg++) {
+        count += lc_invalPage(gfs, fs, lc_compressedBlock(block, pg));
+    }
+    if (count) {
+        __sync_add_and_fetch(&gfs->gfs_precycle, count);
+    }
+}
+
 /* Invalidate pages of parent inode from the cache */
 static void
 lc_invalidateParentPages(struct gfs *gfs, struct fs *fs, struct inode *inode) {
@@ -175,7 +188,9 @@ lc_invalidateParentPages(struct gfs *gfs, struct fs *fs, struct inode *inode) {
     uint64_t i, block;
 
     assert(S_ISREG(inode->i_mode));
-    if (inode->i_extentLength) {
+    if (inode->i_dinode.di_compressed) {
+        lc_invalCompressedPages(gfs, fs, inode->i_extentBlock);
+    } else if (inode->i_extentLength) {
         block = inode->i_extentBlock;
         i = inode->i_extentLength;
         while (i) {
@@ -529,7 +544,7 @@ lc_inodeAllocPages(struct inode *inode) {
 }
 
 /* Get current page dirty list filled up with valid data */
-static char *
+char *
 lc_getDirtyPage(struct gfs *gfs, struct inode *inode, uint64_t pg,
                 struct extent **extents) {
     struct dpage *dpage;
@@ -761,6 +776,214 @@ lc_updateInodeSize(struct gfs *gfs, struct inode *inode,
     }
 }
 
+/* Store a file compressed when all the pages of the file are dirty.  Pages
+ * are compressed in clusters, so that a page can be read in without
+ * decompressing the whole file.  Return false if the file could not be stored
+ * in fewer blocks.
+ */
+static bool
+lc_compressPages(struct gfs *gfs, struct fs *fs, struct inode *inode,
+                 uint64_t lpage) {
+    uint64_t i, j, pg, block, bcount, clusters, pcount, count;
+    struct page *page, *tpage = NULL, *dpage = NULL;
+    struct lbcache *lbcache = fs->fs_bcache;
+    size_t off, max = (lpage - 1) * LC_BLOCK_SIZE;
+    struct dzfile *dzfile;
+    char *zbuf, *cbuf, *data;
+    struct dpage *dp;
+    uLongf csize;
+    int err;
+
+    /* Compress clusters of pages one after the other, after the header */
+    zbuf = lc_malloc(fs, (lpage + LC_COMPRESS_CLUSTER) * LC_BLOCK_SIZE,
+                     LC_MEMTYPE_ZBUF);
+    cbuf = &zbuf[lpage * LC_BLOCK_SIZE];
+    dzfile = (struct dzfile *)zbuf;
+    dzfile->dz_magic = LC_COMPRESS_MAGIC;
+    dzfile->dz_pages = lpage;
+    clusters = (lpage + LC_COMPRESS_CLUSTER - 1) / LC_COMPRESS_CLUSTER;
+    off = sizeof(struct dzfile) + ((clusters + 1) * sizeof(uint32_t));
+    for (i = 0; i < clusters; i++) {
+        dzfile->dz_offset[i] = off;
+        pg = i * LC_COMPRESS_CLUSTER;
+        pcount = lpage - pg;
+        if (pcount > LC_COMPRESS_CLUSTER) {
+            pcount = LC_COMPRESS_CLUSTER;
+        }
+        for (j = 0; j < pcount; j++) {
+            dp = lc_findDirtyPage(inode, pg + j);
+            assert(dp && dp->dp_data);
+            if ((dp->dp_poffset != 0) || (dp->dp_psize != LC_BLOCK_SIZE)) {
+                lc_fillPage(gfs, inode, dp, pg + j, NULL);
+            }
+            memcpy(&cbuf[j * LC_BLOCK_SIZE], dp->dp_data, LC_BLOCK_SIZE);
+        }
+
+        /* Give up if the file is not going to save any space */
+        if (off >= max) {
+            break;
+        }
+        csize = max - off;
+        err = compress2((Bytef *)&zbuf[off], &csize, (Bytef *)cbuf,
+                        pcount * LC_BLOCK_SIZE, gfs->gfs_compress);
+        if (err != Z_OK) {
+            break;
+        }
+        off += csize;
+    }
+    block = LC_INVALID_BLOCK;
+    bcount = (off + LC_BLOCK_SIZE - 1) / LC_BLOCK_SIZE;
+    if (i == clusters) {
+        dzfile->dz_offset[clusters] = off;
+        assert(bcount < lpage);
+        block = lc_blockAlloc(fs, bcount, false, true);
+    }
+    if (block == LC_INVALID_BLOCK) {
+        lc_free(fs, zbuf, (lpage + LC_COMPRESS_CLUSTER) * LC_BLOCK_SIZE,
+                LC_MEMTYPE_ZBUF);
+        return false;
+    }
+
+    /* Pages of any file stored at the same location before are stale */
+    lc_invalCompressedPages(gfs, fs, block);
+
+    /* Queue blocks with compressed data for writing */
+    for (i = 0; i < bcount; i++) {
+        lc_mallocBlockAligned(fs->fs_rfs, (void **)&data, LC_MEMTYPE_DATA);
+        count = off - (i * LC_BLOCK_SIZE);
+        if (count >= LC_BLOCK_SIZE) {
+            count = LC_BLOCK_SIZE;
+        } else {
+            memset(&data[count], 0, LC_BLOCK_SIZE - count);
+        }
+        memcpy(data, &zbuf[i * LC_BLOCK_SIZE], count);
+        page = lc_getPageNew(gfs, fs, block + i, data);
+        assert(page->p_fnext == NULL);
+        assert(page->p_fprev == NULL);
+        assert(page->p_dnext == NULL);
+        if (tpage == NULL) {
+            tpage = page;
+        } else {
+            dpage->p_dnext = page;
+            dpage->p_fnext = page;
+            page->p_fprev = dpage;
+        }
+        dpage = page;
+    }
+    lc_free(fs, zbuf, (lpage + LC_COMPRESS_CLUSTER) * LC_BLOCK_SIZE,
+            LC_MEMTYPE_ZBUF);
+
+    /* Release dirty pages */
+    for (pg = 0; pg < lpage; pg++) {
+        lc_removeDirtyPage(gfs, inode, pg, true, NULL);
+    }
+    assert(lc_inodeGetDirtyPageCount(inode) == 0);
+    inode->i_extentBlock = block;
+    inode->i_extentLength = bcount;
+    inode->i_dinode.di_blocks = bcount;
+    inode->i_dinode.di_compressed = 1;
+    lc_insertPagesToFreeList(lbcache, tpage, dpage);
+    lc_addPageForWriteBack(gfs, fs, tpage, dpage, bcount);
+    count = __sync_fetch_and_sub(&fs->fs_pcount, lpage);
+    assert(count >= lpage);
+    count = __sync_fetch_and_sub(&gfs->gfs_dcount, lpage);
+    assert(count >= lpage);
+    __sync_add_and_fetch(&gfs->gfs_zpages, lpage);
+    __sync_add_and_fetch(&gfs->gfs_zblocks, bcount);
+    return true;
+}
+
+/* Bring in pages of a compressed file as dirty pages before the file is
+ * modified, as compressed data cannot be updated in place.  After this, the
+ * file does not have any blocks.
+ */
+static void
+lc_inflateFile(struct gfs *gfs, struct inode *inode, off_t size) {
+    uint64_t pg, lpage = (size + LC_BLOCK_SIZE - 1) / LC_BLOCK_SIZE;
+    uint64_t block = inode->i_extentBlock, added = 0;
+    struct fs *fs = inode->i_fs;
+    struct dpage dpage, *dp;
+    struct page *page;
+
+    assert(inode->i_dinode.di_compressed);
+    if (lpage > LC_COMPRESS_MAX_PAGES) {
+        lpage = LC_COMPRESS_MAX_PAGES;
+    }
+    if (lpage) {
+        if (lc_inodeGetDirtyPageCount(inode) == 0) {
+            lc_initInodePageMarkers(inode);
+        }
+        lc_inodeAllocPages(inode);
+    }
+    for (pg = 0; pg < lpage; pg++) {
+        dp = lc_findDirtyPage(inode, pg);
+        if (dp && dp->dp_data) {
+            if ((dp->dp_poffset != 0) || (dp->dp_psize != LC_BLOCK_SIZE)) {
+                lc_fillPage(gfs, inode, dp, pg, NULL);
+            }
+            continue;
+        }
+        page = lc_getPageNewData(fs, lc_compressedBlock(block, pg), NULL);
+        if (!page->p_dvalid) {
+            lc_readPages(gfs, fs, &page, 1);
+        }
+        lc_mallocBlockAligned(fs, (void **)&dpage.dp_data, LC_MEMTYPE_DATA);
+        memcpy(dpage.dp_data, page->p_data, LC_BLOCK_SIZE);
+        lc_releasePage(gfs, fs, page, true, false);
+        dpage.dp_poffset = 0;
+        dpage.dp_psize = LC_BLOCK_SIZE;
+        added += lc_mergePage(gfs, inode, pg, &dpage, NULL);
+        if (dpage.dp_data) {
+            lc_freePageData(gfs, fs, dpage.dp_data);
+        }
+    }
+    if (added) {
+        __sync_add_and_fetch(&fs->fs_pcount, added);
+        __sync_add_and_fetch(&gfs->gfs_dcount, added);
+    }
+
+    /* Free blocks if those were allocated in this layer */
+    if (inode->i_private) {
+        lc_addFreedBlocks(fs, block, inode->i_extentLength);
+        lc_invalCompressedPages(gfs, fs, block);
+    }
+    inode->i_extentBlock = 0;
+    inode->i_extentLength = 0;
+    inode->i_dinode.di_blocks = 0;
+    inode->i_dinode.di_compressed = 0;
+    inode->i_private = 1;
+}
+
+/* Return the number of pages in the range which need new blocks, which are
+ * the pages without dirty data and not mapped to blocks allocated in the layer.
+ */
+uint64_t
+lc_newPageCount(struct inode *inode, off_t off, size_t size) {
+    uint64_t page = off / LC_BLOCK_SIZE, count = 0, lpage, block;
+    struct extent *extent = lc_inodeGetEmap(inode);
+    struct fs *fs = inode->i_fs;
+    struct dpage *dpage;
+
+    lpage = (off + size - 1) / LC_BLOCK_SIZE;
+
+    /* Compressed data is replaced by new blocks when modified */
+    if (unlikely(inode->i_dinode.di_compressed)) {
+        return lpage - page + 1;
+    }
+    while (page <= lpage) {
+        dpage = lc_findDirtyPage(inode, page);
+        if ((dpage == NULL) || (dpage->dp_data == NULL)) {
+            block = lc_inodeEmapLookup(fs->fs_gfs, inode, page, &extent);
+            if ((block == LC_PAGE_HOLE) ||
+                !lc_layerBlockAllocated(fs, block)) {
+                count++;
+            }
+        }
+        page++;
+    }
+    return count;
+}
+
 /* Update pages of a file with provided data */
 uint64_t
 lc_addPages(struct inode *inode, off_t off, size_t size,
@@ -775,6 +998,12 @@ lc_addPages(struct inode *inode, off_t off, size_t size,
 
     assert(S_ISREG(inode->i_mode));
 
+    /* Compressed data is replaced by dirty pages before updating the file */
+    if (unlikely(inode->i_dinode.di_compressed)) {
+        lc_inflateFile(gfs, inode, inode->i_size);
+        extent = NULL;
+    }
+
     /* Update inode size if needed */
     lc_updateInodeSize(gfs, inode, off > inode->i_size, endoffset);
 
@@ -829,15 +1058,32 @@ lc_readFile(fuse_req_t req, struct fs *fs, struct inode *inode, off_t soffset,
     struct extent *extent = lc_inodeGetEmap(inode);
     size_t psize, rsize = endoffset - soffset;
     struct page *page = NULL, **rpages = NULL;
+    uint64_t i = 0, scount = 0, mcount = 0;
     off_t poffset, off = soffset;
     struct gfs *gfs = fs->fs_gfs;
+    bool nocache, pin, splice, direct;
     uint32_t rcount = 0;
-    uint64_t i = 0;
-    bool nocache;
     char *data;
     ino_t ino;
 
     assert(S_ISREG(inode->i_mode));
+    pin = (inode->i_flags & LC_INODE_PINNED) || fs->fs_pinned ||
+          inode->i_fs->fs_pinned;
+
+    /* Large reads of image layers could be replied to by splicing blocks not
+     * in cache from the device, instead of reading those into the cache and
+     * copying.  Blocks of image layers are not modified or freed while the
+     * layer is locked.  Only whole blocks are spliced, using a descriptor not
+     * opened for direct I/O.
+     */
+    splice = gfs->gfs_splice && (rsize >= LC_SPLICE_MIN_SIZE) && !pin &&
+             inode->i_fs->fs_readOnly && (fs->fs_mrecord == NULL);
+
+    /* Blocks of a file with a single extent and no dirty pages are computed
+     * from the start of the extent, skipping dirty page and emap lookups.
+     */
+    direct = inode->i_extentLength && !inode->i_dinode.di_compressed &&
+             (lc_inodeGetDirtyPageCount(inode) == 0);
     poffset = soffset % LC_BLOCK_SIZE;
     psize = LC_BLOCK_SIZE - poffset;
     while (rsize) {
@@ -846,18 +1092,41 @@ lc_readFile(fuse_req_t req, struct fs *fs, struct inode *inode, off_t soffset,
             psize = rsize;
         }
         assert((off + psize) <= inode->i_size);
+        bufv->buf[i].flags = 0;
 
         /* Check if a dirty page exists */
-        data = lc_getDirtyPage(gfs, inode, pg, &extent);
+        data = direct ? NULL : lc_getDirtyPage(gfs, inode, pg, &extent);
         if (data == NULL) {
+            if (direct) {
+                block = (pg < inode->i_extentLength) ?
+                        (inode->i_extentBlock + pg) : LC_PAGE_HOLE;
+            } else {
 
-            /* Check emap to find the block of the page
-             * XXX Avoid emap lookup by maintaining a hash table for
-             * <inode, page> lookup.
-             */
-            block = lc_inodeEmapLookup(gfs, inode, pg, &extent);
+                /* Check emap to find the block of the page
+                 * XXX Avoid emap lookup by maintaining a hash table for
+                 * <inode, page> lookup.
+                 */
+                block = lc_inodeEmapLookup(gfs, inode, pg, &extent);
+            }
             if (block == LC_PAGE_HOLE) {
                 bufv->buf[i].mem = gfs->gfs_zPage;
+            } else if (splice && (poffset == 0) &&
+                       (psize == LC_BLOCK_SIZE) &&
+                       !lc_isCompressedBlock(block) &&
+                       !lc_pageCached(fs, block)) {
+                scount++;
+
+                /* Extend previous buffer if blocks are contiguous on disk */
+                if (i && (bufv->buf[i - 1].flags & FUSE_BUF_IS_FD) &&
+                    ((bufv->buf[i - 1].pos + bufv->buf[i - 1].size) ==
+                     (block * LC_BLOCK_SIZE))) {
+                    bufv->buf[i - 1].size += LC_BLOCK_SIZE;
+                    mcount++;
+                    goto next;
+                }
+                bufv->buf[i].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+                bufv->buf[i].fd = gfs->gfs_sfd;
+                bufv->buf[i].pos = block * LC_BLOCK_SIZE;
             } else {
                 page = lc_getPageNewData(fs, block,
                                          dbuf ? dbuf[dcount] : NULL);
@@ -892,16 +1161,24 @@ lc_readFile(fuse_req_t req, struct fs *fs, struct inode *inode, off_t soffset,
         }
         bufv->buf[i].size = psize;
         i++;
+
+next:
         pg++;
         off += psize;
         rsize -= psize;
         poffset = 0;
         psize = LC_BLOCK_SIZE;
     }
-    assert(i == asize);
+    assert((i + mcount) == asize);
     assert(pcount <= asize);
     bufv->count = i;
 
+    /* Record blocks of the image read when a container starts */
+    if (unlikely(fs->fs_mrecord != NULL) && pcount &&
+        inode->i_fs->fs_readOnly) {
+        lc_manifestRecord(fs, pages, pcount);
+    }
+
     /* Read in any pages without valid data associated with */
     if (rcount) {
         rcount = lc_readPages(gfs, fs, rpages, rcount);
@@ -909,8 +1186,16 @@ lc_readFile(fuse_req_t req, struct fs *fs, struct inode *inode, off_t soffset,
     fuse_reply_data(req, bufv, FUSE_BUF_SPLICE_MOVE);
     ino = inode->i_ino;
     lc_inodeUnlock(inode);
+    if (scount) {
+        __sync_add_and_fetch(&gfs->gfs_pspliced, scount);
+    }
     if (pcount) {
 
+        /* Keep pages of pinned files and layers in cache */
+        if (pin) {
+            lc_pinPages(gfs, fs, pages, pcount);
+        }
+
         /* Invalidate pages of read-write layers which are cached in kernel */
         nocache = (ino != gfs->gfs_dbIno) && (ino != gfs->gfs_pluginIno);
         lc_releaseReadPages(gfs, fs, pages, pcount,
@@ -927,6 +1212,7 @@ lc_readFile(fuse_req_t req, struct fs *fs, struct inode *inode, off_t soffset,
 
         /* Consider all the pages read as missed in the cache */
         __sync_add_and_fetch(&gfs->gfs_pmissed, rcount);
+        __sync_add_and_fetch(&fs->fs_bcache->lb_misses, rcount);
     }
     return 0;
 }
@@ -940,10 +1226,10 @@ lc_flushPages(struct gfs *gfs, struct fs *fs, struct inode *inode,
     uint64_t eblock = LC_INVALID_BLOCK, elength = 0, dblocks = 0;
     struct page *page, *dpage = NULL, *tpage = NULL;
     uint64_t fcount = 0, block = LC_INVALID_BLOCK;
-    struct extent *extents = NULL, *extent, *tmp;
+    struct extent *extents = NULL, *extent, *tmp, *shared;
     struct lbcache *lbcache = fs->fs_bcache;
     struct page *first = NULL, *last = NULL;
-    bool single, read, cache;
+    bool single, read, cache, owned = true;
     char *pdata;
     int64_t i;
 
@@ -972,6 +1258,16 @@ lc_flushPages(struct gfs *gfs, struct fs *fs, struct inode *inode,
     assert(start <= end);
     assert(bcount <= (end - start + 1));
 
+    /* Files written to image layers are stored compressed if enabled */
+    if (gfs->gfs_compress && fs->fs_readOnly && fs->fs_gindex &&
+        (start == 0) && (bcount > 1) && (bcount <= LC_COMPRESS_MAX_PAGES) &&
+        (bcount == ((inode->i_size + LC_BLOCK_SIZE - 1) / LC_BLOCK_SIZE)) &&
+        (inode->i_dinode.di_blocks == 0) &&
+        (gfs->gfs_super->sb_tblocks < LC_COMPRESS_BLOCK_MAX) &&
+        lc_compressPages(gfs, fs, inode, bcount)) {
+        goto out;
+    }
+
     /* Allocate blocks.  If a single extent cannot be allocated, allocate
      * smaller chunks.
      */
@@ -1005,9 +1301,11 @@ lc_flushPages(struct gfs *gfs, struct fs *fs, struct inode *inode,
         }
     }
 
-    /* Make a private copy of the emap list if inode is fragmented */
-    if (inode->i_flags & LC_INODE_SHARED) {
-        lc_copyEmap(gfs, fs, inode);
+    /* Make a private copy of the part of the emap list being modified, rest
+     * of the list could still be shared with the parent layer.
+     */
+    if (!single) {
+        lc_unshareEmap(gfs, fs, inode, end + 1);
     }
 
     /* Check if file has a single extent */
@@ -1096,7 +1394,7 @@ lc_flushPages(struct gfs *gfs, struct fs *fs, struct inode *inode,
             }
             page = lc_getPageNew(gfs, fs, block + count, pdata);
 
-            if (read) {
+            if (read && (page->p_hitCount < LC_PAGE_HITS_MAX)) {
                 page->p_hitCount++;
             }
             assert(page->p_fnext == NULL);
@@ -1143,18 +1441,29 @@ lc_flushPages(struct gfs *gfs, struct fs *fs, struct inode *inode,
             }
         } else if (lc_inodeGetEmap(inode)) {
 
-            /* Traverse the extent list and free every extent */
+            /* Traverse the extent list and free every extent, except those
+             * shared with parent layer.
+             */
             extent = lc_inodeGetEmap(inode);
+            shared = lc_inodeGetSharedEmap(inode);
             while (extent) {
                 assert(extent->ex_type == LC_EXTENT_EMAP);
                 lc_validateExtent(gfs, extent);
                 lc_addSpaceExtent(gfs, fs, &extents, lc_getExtentBlock(extent),
                                   lc_getExtentCount(extent), false);
+                if (extent == shared) {
+                    owned = false;
+                }
                 tmp = extent;
                 extent = extent->ex_next;
-                lc_free(fs, tmp, sizeof(struct extent), LC_MEMTYPE_EXTENT);
+                if (owned) {
+                    lc_free(fs, tmp, sizeof(struct extent),
+                            LC_MEMTYPE_EXTENT);
+                }
             }
             lc_inodeSetEmap(inode, NULL);
+            lc_inodeSetSharedEmap(inode, NULL);
+            inode->i_flags &= ~LC_INODE_SHARED;
         }
         inode->i_extentBlock = eblock;
         inode->i_extentLength = elength;
@@ -1398,7 +1707,12 @@ lc_truncateFile(struct inode *inode, off_t size, bool remove) {
     fs = inode->i_fs;
     gfs = fs->fs_gfs;
 
-    /* Copy emap list before changing it */
+    /* Bring in pages of a compressed file before truncating it */
+    if (unlikely(inode->i_dinode.di_compressed) && remove) {
+        lc_inflateFile(gfs, inode, size);
+    }
+
+    /* Copy emap list before changing it, except extents past the new size */
     if (inode->i_flags & LC_INODE_SHARED) {
         if (size == 0) {
 
@@ -1414,7 +1728,9 @@ lc_truncateFile(struct inode *inode, off_t size, bool remove) {
             lc_invalidatePages(gfs, fs, inode, size);
             return;
         }
-        lc_copyEmap(gfs, fs, inode);
+    }
+    if (remove) {
+        lc_unshareEmap(gfs, fs, inode, pg);
     }
     assert(!(inode->i_flags & LC_INODE_SHARED));
 
@@ -6,6 +6,28 @@
 /* HOLE representation for a page of an inode */
 #define LC_PAGE_HOLE       ((uint64_t)-1)
 
+/* Pages of compressed files are cached using the first block of the file and
+ * the page number, with this bit set.
+ */
+#define LC_PAGE_COMPRESSED      (1ul << 47)
+
+/* Number of bits for page number in cache index of compressed pages */
+#define LC_COMPRESS_SHIFT       12
+
+/* Files are compressed only on devices smaller than this */
+#define LC_COMPRESS_BLOCK_MAX   ((1ul << 35) - 1)
+
+/* Maximum number of blocks a compressed cluster could span */
+#define LC_COMPRESS_CBLOCKS     (LC_COMPRESS_CLUSTER + 2)
+
+/* Default compression level */
+#define LC_COMPRESS_LEVEL       Z_BEST_SPEED
+
+/* Reads of at least this size from image layers could be replied to by
+ * splicing uncached blocks from the device.
+ */
+#define LC_SPLICE_MIN_SIZE      (128 * 1024)
+
 /* Initial size of the page hash table */
 /* XXX This needs to consider available memory */
 #define LC_PCACHE_SIZE_MIN  1024
@@ -14,6 +36,9 @@
 /* Number of locks for the block cache hash lists */
 #define LC_PCLOCK_COUNT     1024
 
+/* Maximum hit count tracked for a page */
+#define LC_PAGE_HITS_MAX    ((1u << 22) - 1)
+
 /* Number of hash lists for the dirty pages */
 /* XXX Adjust this with size of the file */
 #define LC_PAGECACHE_SIZE  32
@@ -40,6 +65,74 @@
  */
 #define LC_PCACHE_MEMORY_MIN    5
 
+/* Default memory in bytes allowed for pinned pages */
+#define LC_PIN_MEMORY           (64ull * 1024ull * 1024ull)
+
+/* Maximum memory allowed for pinned pages as a percentage of memory for data
+ * pages, so that the cleaner can always make progress.
+ */
+#define LC_PIN_MEMORY_MAX       50
+
+/* Maximum number of blocks recorded in an access manifest */
+#define LC_MANIFEST_MAX         16384
+
+/* Time in seconds reads are recorded after a container is created */
+#define LC_MANIFEST_TIME        10
+
+/* Size of the hash table used for skipping blocks recorded already */
+#define LC_MANIFEST_HASH_SIZE   (LC_MANIFEST_MAX * 2)
+
+/* Blocks of an image layer read when containers start, recorded in the order
+ * those were read first, for prefetching those for other containers.
+ */
+struct manifest {
+
+    /* Lock serializing recording */
+    pthread_mutex_t m_lock;
+
+    /* Blocks recorded */
+    uint64_t *m_blocks;
+
+    /* Hash table of blocks recorded, 0 for empty slots */
+    uint64_t *m_hash;
+
+    /* Time recording ends */
+    time_t m_end;
+
+    /* Number of blocks recorded */
+    uint32_t m_count;
+
+    /* Number of times blocks prefetched */
+    uint32_t m_prefetched;
+};
+
+/* Prefetch of an image layer handed to a prefetch thread */
+struct prefetch {
+
+    /* Global file system */
+    struct gfs *pf_gfs;
+
+    /* Root inode of the image layer */
+    ino_t pf_root;
+
+    /* Index of the image layer */
+    int pf_gindex;
+};
+
+/* Cache index of a page of a compressed file starting at the block */
+static inline uint64_t
+lc_compressedBlock(uint64_t block, uint64_t pg) {
+    assert(block < LC_COMPRESS_BLOCK_MAX);
+    assert(pg < LC_COMPRESS_MAX_PAGES);
+    return LC_PAGE_COMPRESSED | (block << LC_COMPRESS_SHIFT) | pg;
+}
+
+/* Check if a cache index is for a page of a compressed file */
+static inline bool
+lc_isCompressedBlock(uint64_t block) {
+    return (block != LC_INVALID_BLOCK) && (block & LC_PAGE_COMPRESSED);
+}
+
 /* Maximum number of dirty pages a file could have before flushing triggered */
 #define LC_MAX_FILE_DIRTYPAGES  131072
 
@@ -70,6 +163,11 @@
 /* Number of pages freed in one pass */
 #define LC_PAGE_PURGE_COUNT        4096
 
+/* Minimum interval in seconds between rebalancing the page budget across
+ * block caches of layer trees.
+ */
+#define LC_BCACHE_BALANCE_INTERVAL 10
+
 /* Page cache header */
 struct pcache {
     /* Page hash chains */
@@ -109,6 +207,27 @@ struct lbcache {
 
     /* Count of clean pages */
     uint64_t lb_pcount;
+
+    /* Pages this cache could keep when memory is tight */
+    uint64_t lb_target;
+
+    /* Recent activity on the cache, decayed on every rebalance */
+    uint64_t lb_weight;
+
+    /* Number of lookups found the page cached */
+    uint64_t lb_hits;
+
+    /* Number of pages read from disk */
+    uint64_t lb_misses;
+
+    /* Hits when the cache was rebalanced last time */
+    uint64_t lb_lhits;
+
+    /* Misses when the cache was rebalanced last time */
+    uint64_t lb_lmisses;
+
+    /* Number of pages purged */
+    uint64_t lb_purged;
 } __attribute__((packed));
 
 /* Page structure used for caching a file system block */
@@ -126,8 +245,11 @@ struct page {
     /* Reference count on this page */
     uint32_t p_refCount;
 
-    /* Page cache hitcount */
-    uint32_t p_hitCount:27;
+    /* Page cache hitcount, saturates at LC_PAGE_HITS_MAX */
+    uint32_t p_hitCount:22;
+
+    /* NUMA node holding the data of the page */
+    uint32_t p_node:4;
 
     /* page is not in hash lists */
     uint32_t p_nohash:1;
@@ -141,6 +263,9 @@ struct page {
     /* Set to invalidate when released */
     uint32_t p_nocache:1;
 
+    /* Pinned in cache for a pinned file or layer */
+    uint32_t p_pinned:1;
+
     /* Set if data is valid */
     uint32_t p_dvalid:1;
 
@@ -0,0 +1,753 @@
+#include "includes.h"
+
+/* Write to the stream, remembering the first error */
+static void
+lc_streamWrite(struct sstream *ss, const void *buf, size_t size) {
+    if (!ss->ss_err && size && (fwrite(buf, size, 1, ss->ss_fp) != 1)) {
+        ss->ss_err = errno ? errno : EIO;
+    }
+}
+
+/* Read from the stream, remembering the first error */
+static void
+lc_streamRead(struct sstream *ss, void *buf, size_t size) {
+    if (!ss->ss_err && size && (fread(buf, size, 1, ss->ss_fp) != 1)) {
+        ss->ss_err = ferror(ss->ss_fp) ? EIO : EINVAL;
+    }
+}
+
+/* Parse a request in the form "<layer> <fd>" and open the stream file the
+ * caller has open as the descriptor.  The caller opens the file, so that the
+ * daemon does not access files the caller could not.  Layer is locked shared
+ * while the stream is processed, so that the flusher could write out pages.
+ */
+static struct fs *
+lc_streamOpen(fuse_req_t req, struct sstream *ss, char *name, bool send) {
+    const struct fuse_ctx *ctx = fuse_req_ctx(req);
+    struct fs *fs, *rfs;
+    char *file, *end;
+    ino_t root;
+    long sfd;
+    int fd;
+
+    memset(ss, 0, sizeof(struct sstream));
+
+    /* Layers are exported and imported only by root */
+    if (ctx->uid != 0) {
+        ss->ss_err = EPERM;
+        return NULL;
+    }
+    file = strchr(name, ' ');
+    if ((file == NULL) || (file == name)) {
+        ss->ss_err = EINVAL;
+        return NULL;
+    }
+    *file = 0;
+    file++;
+    sfd = strtol(file, &end, 10);
+    if ((end == file) || *end || (sfd < 0) || (sfd > INT_MAX)) {
+        ss->ss_err = EINVAL;
+        return NULL;
+    }
+    rfs = lc_getLayerLocked(LC_ROOT_INODE, false);
+    root = lc_getRootIno(rfs, name, NULL, true);
+    if (root == LC_INVALID_INODE) {
+        lc_unlock(rfs);
+        ss->ss_err = ENOENT;
+        return NULL;
+    }
+    fs = lc_getLayerLocked(root, false);
+    lc_unlock(rfs);
+    if (fs->fs_removed) {
+        lc_unlock(fs);
+        ss->ss_err = ENOENT;
+        return NULL;
+    }
+    ss->ss_fs = fs;
+    fd = lc_openProcessFile(ctx->pid, sfd, send ? O_WRONLY : O_RDONLY);
+    if (fd == -1) {
+        ss->ss_err = errno;
+        return fs;
+    }
+    ss->ss_fp = fdopen(fd, send ? "w" : "r");
+    if (ss->ss_fp == NULL) {
+        ss->ss_err = errno;
+        close(fd);
+    }
+    return fs;
+}
+
+/* Close the stream file and respond to the request */
+static void
+lc_streamClose(fuse_req_t req, struct sstream *ss, const char *op) {
+    struct fs *fs = ss->ss_fs;
+    int gindex = -1;
+
+    if (ss->ss_fp && fclose(ss->ss_fp) && !ss->ss_err) {
+        ss->ss_err = errno ? errno : EIO;
+    }
+    if (fs) {
+        gindex = fs->fs_gindex;
+        lc_unlock(fs);
+    }
+    if (ss->ss_err) {
+        lc_reportError(op, __LINE__, 0, ss->ss_err);
+        fuse_reply_err(req, ss->ss_err);
+    } else {
+        lc_syslog(LOG_INFO, "%s layer %d, %ld records %ld blocks\n",
+                  op, gindex, ss->ss_records, ss->ss_blocks);
+        fuse_reply_ioctl(req, 0, NULL, 0);
+    }
+}
+
+/* Write a record to the stream */
+static void
+lc_sendRecord(struct sstream *ss, struct inode *inode, uint8_t type,
+              const char *path, uint16_t len, const char *target,
+              uint16_t tlen) {
+    struct srecord srecord;
+    struct xattr *xattr;
+    struct sxattr sxattr;
+
+    memset(&srecord, 0, sizeof(struct srecord));
+    srecord.sr_type = type;
+    srecord.sr_len = len;
+    srecord.sr_tlen = tlen;
+    if (inode) {
+        srecord.sr_mode = inode->i_mode;
+        srecord.sr_uid = inode->i_dinode.di_uid;
+        srecord.sr_gid = inode->i_dinode.di_gid;
+        srecord.sr_rdev = inode->i_dinode.di_rdev;
+        srecord.sr_size = inode->i_size;
+        srecord.sr_mtime = inode->i_dinode.di_mtime.tv_sec;
+        srecord.sr_mtimeNsec = inode->i_dinode.di_mtime.tv_nsec;
+        srecord.sr_ctime = inode->i_dinode.di_ctime.tv_sec;
+        srecord.sr_ctimeNsec = inode->i_dinode.di_ctime.tv_nsec;
+        xattr = inode->i_xattrData ? inode->i_xattr : NULL;
+        while (xattr) {
+            srecord.sr_xcount++;
+            xattr = xattr->x_next;
+        }
+    }
+    lc_streamWrite(ss, &srecord, sizeof(struct srecord));
+    lc_streamWrite(ss, path, len);
+    lc_streamWrite(ss, target, tlen);
+    xattr = srecord.sr_xcount ? inode->i_xattr : NULL;
+    while (xattr) {
+        sxattr.sx_len = strlen(xattr->x_name);
+        sxattr.sx_size = xattr->x_size;
+        lc_streamWrite(ss, &sxattr, sizeof(struct sxattr));
+        lc_streamWrite(ss, xattr->x_name, sxattr.sx_len);
+        if (xattr->x_value) {
+            lc_streamWrite(ss, xattr->x_value, xattr->x_size);
+        }
+        xattr = xattr->x_next;
+    }
+    ss->ss_records++;
+}
+
+/* Write data of a file to the stream as extents of blocks, skipping holes */
+static void
+lc_sendData(struct sstream *ss, struct inode *inode) {
+    struct page *pages[LC_SEND_EXTENT_MAX], *rpages[LC_SEND_EXTENT_MAX];
+    uint64_t pg = 0, lpage, block, count, pcount, rcount, i;
+    struct extent *extent = lc_inodeGetEmap(inode);
+    char *data[LC_SEND_EXTENT_MAX];
+    struct fs *fs = ss->ss_fs;
+    struct gfs *gfs = fs->fs_gfs;
+    struct sextent sextent;
+    struct page *page;
+
+    lpage = (inode->i_size + LC_BLOCK_SIZE - 1) / LC_BLOCK_SIZE;
+    while ((pg < lpage) && !ss->ss_err) {
+
+        /* Collect pages until a hole or the maximum extent size */
+        count = 0;
+        pcount = 0;
+        rcount = 0;
+        while (((pg + count) < lpage) && (count < LC_SEND_EXTENT_MAX)) {
+            data[count] = lc_getDirtyPage(gfs, inode, pg + count, &extent);
+            if (data[count] == NULL) {
+                block = lc_inodeEmapLookup(gfs, inode, pg + count, &extent);
+                if (block == LC_PAGE_HOLE) {
+                    break;
+                }
+                page = lc_getPageNewData(fs, block, NULL);
+                if (!page->p_dvalid) {
+                    rpages[rcount++] = page;
+                }
+                pages[pcount++] = page;
+                data[count] = page->p_data;
+            }
+            count++;
+        }
+        if (count == 0) {
+            pg++;
+            continue;
+        }
+        if (rcount) {
+            lc_readPages(gfs, fs, rpages, rcount);
+        }
+        lc_waitMemory(gfs, false);
+        sextent.se_page = pg;
+        sextent.se_count = count;
+        lc_streamWrite(ss, &sextent, sizeof(struct sextent));
+        for (i = 0; i < count; i++) {
+            lc_streamWrite(ss, data[i], LC_BLOCK_SIZE);
+        }
+        if (pcount) {
+            lc_releaseReadPages(gfs, fs, pages, pcount, false, false);
+        }
+        ss->ss_blocks += count;
+        pg += count;
+    }
+
+    /* Terminate the list of extents */
+    sextent.se_page = 0;
+    sextent.se_count = 0;
+    lc_streamWrite(ss, &sextent, sizeof(struct sextent));
+}
+
+/* Write a file to the stream, as a link to the file if written already */
+static void
+lc_sendFile(struct sstream *ss, struct inode *inode, const char *path,
+            uint16_t len) {
+    struct fs *fs = ss->ss_fs;
+    struct slink *slink;
+
+    if (inode->i_nlink > 1) {
+        slink = ss->ss_links;
+        while (slink && (slink->sl_ino != inode->i_ino)) {
+            slink = slink->sl_next;
+        }
+        if (slink) {
+            lc_sendRecord(ss, NULL, LC_SEND_LINK, path, len,
+                          slink->sl_path, slink->sl_len);
+            return;
+        }
+
+        /* Remember the path for sending other links to the file */
+        slink = lc_malloc(fs, sizeof(struct slink), LC_MEMTYPE_HLDATA);
+        slink->sl_ino = inode->i_ino;
+        slink->sl_path = lc_malloc(fs, len, LC_MEMTYPE_PATH);
+        memcpy(slink->sl_path, path, len);
+        slink->sl_len = len;
+        slink->sl_next = ss->ss_links;
+        ss->ss_links = slink;
+    }
+    if (S_ISLNK(inode->i_mode)) {
+        lc_sendRecord(ss, inode, LC_SEND_FILE, path, len, inode->i_target,
+                      inode->i_size);
+    } else {
+        lc_sendRecord(ss, inode, LC_SEND_FILE, path, len, NULL, 0);
+        if (S_ISREG(inode->i_mode) && inode->i_size) {
+            lc_sendData(ss, inode);
+        }
+    }
+}
+
+/* Write records for a directory and files changed in it */
+static void
+lc_sendDirectory(struct sstream *ss, struct cdir *cdir, char *path) {
+    uint16_t plen = (cdir->cd_len > 1) ? cdir->cd_len : 0, len;
+    struct fs *fs = ss->ss_fs;
+    struct inode *dir, *inode;
+    struct cfile *cfile;
+    ino_t ino;
+
+    dir = lc_getInode(fs, cdir->cd_ino, NULL, false, false);
+    lc_sendRecord(ss, dir, LC_SEND_DIRECTORY, cdir->cd_path, cdir->cd_len,
+                  NULL, 0);
+    memcpy(path, cdir->cd_path, plen);
+    path[plen] = '/';
+    cfile = cdir->cd_file;
+    while (cfile && !ss->ss_err) {
+        len = plen + cfile->cf_len + 1;
+        if (len >= PATH_MAX) {
+            ss->ss_err = ENAMETOOLONG;
+            break;
+        }
+        memcpy(&path[plen + 1], cfile->cf_name, cfile->cf_len);
+        path[len] = 0;
+        if (cfile->cf_type == LC_REMOVED) {
+            lc_sendRecord(ss, NULL, LC_SEND_WHITEOUT, path, len, NULL, 0);
+        } else {
+            ino = lc_dirLookup(fs, dir, &path[plen + 1]);
+            assert(ino != LC_INVALID_INODE);
+            inode = lc_getInode(fs, ino, NULL, false, false);
+            lc_sendFile(ss, inode, path, len);
+            lc_inodeUnlock(inode);
+        }
+        cfile = cfile->cf_next;
+    }
+    lc_inodeUnlock(dir);
+}
+
+/* Write an immutable layer to a stream file, with changes relative to its
+ * parent layer.  Request is in the form "<layer> <fd>".  Files are
+ * identified by paths as inode numbers are different on other hosts.
+ */
+void
+lc_layerSend(fuse_req_t req, struct gfs *gfs, char *name) {
+    struct sheader sheader;
+    struct slink *slink;
+    struct sstream ss;
+    struct inode *dir;
+    struct cdir *cdir;
+    struct fs *fs;
+    char *path;
+
+    fs = lc_streamOpen(req, &ss, name, true);
+    if (ss.ss_err) {
+        goto out;
+    }
+    if (!fs->fs_frozen || fs->fs_rfs->fs_restarted) {
+        ss.ss_err = EINVAL;
+        goto out;
+    }
+
+    /* Change list is used by an ongoing diff or send of the layer.  A diff
+     * locks the layer exclusive, so cannot start while this is in progress.
+     */
+    if (!__sync_bool_compare_and_swap(&fs->fs_sending, false, true)) {
+        ss.ss_err = EBUSY;
+        goto out;
+    }
+    if (fs->fs_changes) {
+        fs->fs_sending = false;
+        ss.ss_err = EBUSY;
+        goto out;
+    }
+    lc_printf("Sending layer %d\n", fs->fs_gindex);
+    sheader.sh_magic = LC_SEND_MAGIC;
+    sheader.sh_version = LC_SEND_VERSION;
+    lc_streamWrite(&ss, &sheader, sizeof(struct sheader));
+    lc_buildChangeList(fs);
+
+    /* Directories are listed after their parent directories */
+    path = lc_malloc(fs, PATH_MAX, LC_MEMTYPE_PATH);
+    cdir = fs->fs_changes;
+    while (cdir && !ss.ss_err) {
+        lc_sendDirectory(&ss, cdir, path);
+        cdir = cdir->cd_next;
+    }
+    lc_free(fs, path, PATH_MAX, LC_MEMTYPE_PATH);
+
+    /* Directory records are repeated at the end for restoring times of
+     * directories modified while populating those.
+     */
+    cdir = fs->fs_changes;
+    while (cdir && !ss.ss_err) {
+        dir = lc_getInode(fs, cdir->cd_ino, NULL, false, false);
+        lc_sendRecord(&ss, dir, LC_SEND_DIRECTORY, cdir->cd_path,
+                      cdir->cd_len, NULL, 0);
+        lc_inodeUnlock(dir);
+        cdir = cdir->cd_next;
+    }
+    lc_sendRecord(&ss, NULL, LC_SEND_END, NULL, 0, NULL, 0);
+    lc_freeChangeList(fs);
+    fs->fs_sending = false;
+    while ((slink = ss.ss_links)) {
+        ss.ss_links = slink->sl_next;
+        lc_free(fs, slink->sl_path, slink->sl_len, LC_MEMTYPE_PATH);
+        lc_free(fs, slink, sizeof(struct slink), LC_MEMTYPE_HLDATA);
+    }
+
+out:
+    lc_streamClose(req, &ss, __func__);
+}
+
+/* Lookup the inode number of a path in the layer.  Path is modified in the
+ * process.
+ */
+static ino_t
+lc_receivePath(struct fs *fs, char *path, uint16_t len) {
+    char *name = &path[1], *next;
+    ino_t ino = fs->fs_root;
+    struct inode *dir;
+    bool isdir;
+
+    path[len] = 0;
+    while (*name) {
+        next = strchr(name, '/');
+        if (next) {
+            *next = 0;
+        }
+        dir = lc_getInode(fs, ino, NULL, false, false);
+        isdir = S_ISDIR(dir->i_mode);
+        ino = isdir ? lc_dirLookup(fs, dir, name) : LC_INVALID_INODE;
+        lc_inodeUnlock(dir);
+        if ((ino == LC_INVALID_INODE) || (next == NULL)) {
+            break;
+        }
+        name = next + 1;
+    }
+    return ino;
+}
+
+/* Lookup the parent directory of a path and return the directory cloned to
+ * the layer, along with the name in the directory.
+ */
+static struct inode *
+lc_receiveDirectory(struct fs *fs, char *path, uint16_t len, char **name) {
+    struct inode *dir;
+    uint16_t i = len;
+    ino_t ino;
+
+    while (i && (path[i - 1] != '/')) {
+        i--;
+    }
+    if (i == 0) {
+        return NULL;
+    }
+    *name = &path[i];
+    ino = (i == 1) ? fs->fs_root : lc_receivePath(fs, path, i - 1);
+    if (ino == LC_INVALID_INODE) {
+        return NULL;
+    }
+    dir = lc_getInode(fs, ino, NULL, true, true);
+    if (!S_ISDIR(dir->i_mode)) {
+        lc_inodeUnlock(dir);
+        return NULL;
+    }
+    if (dir->i_flags & LC_INODE_SHARED) {
+        lc_dirCopy(dir);
+    }
+    return dir;
+}
+
+/* Remove a name from a directory along with everything under it */
+static int
+lc_receiveRemove(struct fs *fs, struct inode *dir, const char *name) {
+    char cname[LC_FILENAME_MAX + 1];
+    struct dirent *dirent = NULL;
+    struct inode *inode;
+    bool rmdir, empty;
+    int i, err = 0;
+    ino_t ino;
+
+    ino = lc_dirLookup(fs, dir, name);
+    if (ino == LC_INVALID_INODE) {
+        return 0;
+    }
+    inode = lc_getInode(fs, ino, NULL, false, false);
+    rmdir = S_ISDIR(inode->i_mode);
+    empty = (inode->i_size == 0);
+    lc_inodeUnlock(inode);
+
+    /* Directories are emptied before removing those */
+    if (rmdir && !empty) {
+        inode = lc_getInode(fs, ino, NULL, true, true);
+        if (inode->i_flags & LC_INODE_SHARED) {
+            lc_dirCopy(inode);
+        }
+        while (inode->i_size && !err) {
+            if (inode->i_flags & LC_INODE_DHASHED) {
+                for (i = 0; i < LC_DIRCACHE_SIZE; i++) {
+                    dirent = inode->i_hdirent[i];
+                    if (dirent) {
+                        break;
+                    }
+                }
+            } else {
+                dirent = inode->i_dirent;
+            }
+            memcpy(cname, dirent->di_name, dirent->di_size);
+            cname[dirent->di_size] = 0;
+            err = lc_receiveRemove(fs, inode, cname);
+        }
+        lc_inodeUnlock(inode);
+    }
+    if (!err) {
+        err = lc_dirRemoveName(fs, dir, name, rmdir, NULL, false);
+    }
+    return err;
+}
+
+/* Create a new inode with the attributes received */
+static struct inode *
+lc_receiveCreate(struct fs *fs, struct inode *dir, const char *name,
+                 struct srecord *srecord, const char *target) {
+    struct inode *inode;
+
+    inode = lc_inodeInit(fs, srecord->sr_mode, srecord->sr_uid,
+                         srecord->sr_gid, srecord->sr_rdev, dir->i_ino,
+                         S_ISLNK(srecord->sr_mode) ? target : NULL);
+    lc_dirAdd(dir, inode->i_ino, srecord->sr_mode, name, strlen(name));
+    if (S_ISDIR(srecord->sr_mode)) {
+        dir->i_nlink++;
+    }
+    lc_markInodeDirty(dir, LC_INODE_DIRDIRTY);
+    return inode;
+}
+
+/* Read extended attributes of an inode, replacing existing ones */
+static void
+lc_receiveXattrs(struct sstream *ss, struct inode *inode,
+                 struct srecord *srecord) {
+    char *name, *value;
+    struct sxattr sxattr;
+    uint16_t i;
+
+    if (inode->i_xattrData) {
+        lc_xattrFree(inode);
+        lc_markInodeDirty(inode, LC_INODE_XATTRDIRTY);
+    }
+    if (srecord->sr_xcount == 0) {
+        return;
+    }
+    name = lc_malloc(ss->ss_fs, LC_BLOCK_SIZE, LC_MEMTYPE_XATTRBUF);
+    value = lc_malloc(ss->ss_fs, LC_BLOCK_SIZE, LC_MEMTYPE_XATTRBUF);
+    for (i = 0; (i < srecord->sr_xcount) && !ss->ss_err; i++) {
+        lc_streamRead(ss, &sxattr, sizeof(struct sxattr));
+        if (!ss->ss_err && ((sxattr.sx_len == 0) ||
+                            (sxattr.sx_len >= LC_BLOCK_SIZE) ||
+                            (sxattr.sx_size >= LC_BLOCK_SIZE))) {
+            ss->ss_err = EINVAL;
+        }
+        lc_streamRead(ss, name, sxattr.sx_len);
+        lc_streamRead(ss, value, sxattr.sx_size);
+        if (!ss->ss_err) {
+            lc_xattrSet(inode, name, sxattr.sx_len, value, sxattr.sx_size);
+        }
+    }
+    lc_free(ss->ss_fs, value, LC_BLOCK_SIZE, LC_MEMTYPE_XATTRBUF);
+    lc_free(ss->ss_fs, name, LC_BLOCK_SIZE, LC_MEMTYPE_XATTRBUF);
+}
+
+/* Read data of a file and write it to newly allocated blocks */
+static void
+lc_receiveData(struct sstream *ss, struct inode *inode, uint64_t size) {
+    struct dpage dpages[LC_SEND_EXTENT_MAX];
+    uint64_t i, count, added, psize;
+    struct fs *fs = ss->ss_fs;
+    struct gfs *gfs = fs->fs_gfs;
+    struct sextent sextent;
+    size_t dsize;
+    off_t off;
+
+    for (;;) {
+        lc_streamRead(ss, &sextent, sizeof(struct sextent));
+        if (ss->ss_err || (sextent.se_count == 0)) {
+            break;
+        }
+        count = sextent.se_count;
+        off = sextent.se_page * LC_BLOCK_SIZE;
+        if ((count > LC_SEND_EXTENT_MAX) ||
+            ((off + ((count - 1) * LC_BLOCK_SIZE)) >= size)) {
+            ss->ss_err = EINVAL;
+            break;
+        }
+
+        /* Let the flusher write out pages when running low on memory */
+        lc_waitMemory(gfs, true);
+        dsize = 0;
+        for (i = 0; i < count; i++) {
+            psize = size - (off + dsize);
+            if (psize > LC_BLOCK_SIZE) {
+                psize = LC_BLOCK_SIZE;
+            }
+            lc_mallocBlockAligned(fs, (void **)&dpages[i].dp_data,
+                                  LC_MEMTYPE_DATA);
+            dpages[i].dp_poffset = 0;
+            dpages[i].dp_psize = psize;
+            dpages[i].dp_pread = 0;
+            lc_streamRead(ss, dpages[i].dp_data, LC_BLOCK_SIZE);
+            dsize += psize;
+        }
+        added = ss->ss_err ? 0 : lc_addPages(inode, off, dsize, dpages, count);
+        lc_freePages(fs, dpages, count);
+        if (added) {
+            __sync_add_and_fetch(&fs->fs_pcount, added);
+            __sync_add_and_fetch(&gfs->gfs_dcount, added);
+        }
+        ss->ss_blocks += count;
+    }
+
+    /* Files may end with a hole */
+    if (inode->i_size < size) {
+        inode->i_size = size;
+    }
+    lc_markInodeDirty(inode, LC_INODE_EMAPDIRTY);
+
+    /* Allocate blocks for the file like when it is closed after writing */
+    if (lc_inodeGetDirtyPageCount(inode)) {
+        lc_flushPages(gfs, fs, inode, true, false);
+    }
+}
+
+/* Process a record read from the stream */
+static void
+lc_receiveRecord(struct sstream *ss, struct srecord *srecord, char *path,
+                 char *target) {
+    struct inode *dir = NULL, *inode = NULL;
+    struct fs *fs = ss->ss_fs;
+    ino_t ino = LC_INVALID_INODE;
+    char *name = NULL;
+    bool isdir;
+
+    if ((srecord->sr_len == 0) || (srecord->sr_len >= PATH_MAX) ||
+        (srecord->sr_tlen >= PATH_MAX)) {
+        ss->ss_err = EINVAL;
+        return;
+    }
+    lc_streamRead(ss, path, srecord->sr_len);
+    lc_streamRead(ss, target, srecord->sr_tlen);
+    if (ss->ss_err || (path[0] != '/')) {
+        ss->ss_err = EINVAL;
+        return;
+    }
+    path[srecord->sr_len] = 0;
+    target[srecord->sr_tlen] = 0;
+
+    /* Lookup the file a hard link points to */
+    if (srecord->sr_type == LC_SEND_LINK) {
+        ino = (target[0] == '/') ?
+              lc_receivePath(fs, target, srecord->sr_tlen) : LC_INVALID_INODE;
+        if (ino == LC_INVALID_INODE) {
+            ss->ss_err = EINVAL;
+            return;
+        }
+    }
+
+    /* Root directory of the layer is updated in place */
+    if ((srecord->sr_type == LC_SEND_DIRECTORY) && (srecord->sr_len == 1)) {
+        inode = lc_getInode(fs, fs->fs_root, NULL, true, true);
+    } else {
+        dir = lc_receiveDirectory(fs, path, srecord->sr_len, &name);
+        if ((dir == NULL) || (*name == 0)) {
+            if (dir) {
+                lc_inodeUnlock(dir);
+            }
+            ss->ss_err = EINVAL;
+            return;
+        }
+    }
+    switch (srecord->sr_type) {
+    case LC_SEND_DIRECTORY:
+        if (inode) {
+            break;
+        }
+
+        /* Keep an existing directory, replacing anything else */
+        ino = lc_dirLookup(fs, dir, name);
+        if (ino != LC_INVALID_INODE) {
+            inode = lc_getInode(fs, ino, NULL, false, false);
+            isdir = S_ISDIR(inode->i_mode);
+            lc_inodeUnlock(inode);
+            if (isdir) {
+                inode = lc_getInode(fs, ino, NULL, true, true);
+            } else {
+                ss->ss_err = lc_receiveRemove(fs, dir, name);
+                inode = NULL;
+            }
+        }
+        if ((inode == NULL) && !ss->ss_err) {
+            inode = lc_receiveCreate(fs, dir, name, srecord, NULL);
+        }
+        break;
+
+    case LC_SEND_FILE:
+        ss->ss_err = lc_receiveRemove(fs, dir, name);
+        if (!ss->ss_err) {
+            inode = lc_receiveCreate(fs, dir, name, srecord, target);
+        }
+        break;
+
+    case LC_SEND_LINK:
+        ss->ss_err = lc_receiveRemove(fs, dir, name);
+        if (ss->ss_err) {
+            break;
+        }
+        inode = lc_getInode(fs, ino, NULL, true, true);
+        if (S_ISDIR(inode->i_mode)) {
+            lc_inodeUnlock(inode);
+            ss->ss_err = EINVAL;
+            break;
+        }
+        lc_dirAdd(dir, inode->i_ino, inode->i_mode, name, strlen(name));
+        lc_markInodeDirty(dir, LC_INODE_DIRDIRTY);
+        lc_addHlink(fs, inode, dir->i_ino);
+        inode->i_nlink++;
+        lc_markInodeDirty(inode, 0);
+        lc_inodeUnlock(inode);
+        inode = NULL;
+        break;
+
+    case LC_SEND_WHITEOUT:
+        ss->ss_err = lc_receiveRemove(fs, dir, name);
+        break;
+
+    default:
+        ss->ss_err = EINVAL;
+    }
+    if (dir) {
+        lc_inodeUnlock(dir);
+    }
+    if (inode == NULL) {
+        return;
+    }
+
+    /* Update attributes of the file */
+    if (!ss->ss_err) {
+        inode->i_mode = srecord->sr_mode;
+        inode->i_dinode.di_uid = srecord->sr_uid;
+        inode->i_dinode.di_gid = srecord->sr_gid;
+        lc_receiveXattrs(ss, inode, srecord);
+        if (S_ISREG(inode->i_mode) && srecord->sr_size && !ss->ss_err) {
+            lc_receiveData(ss, inode, srecord->sr_size);
+        }
+        inode->i_dinode.di_mtime.tv_sec = srecord->sr_mtime;
+        inode->i_dinode.di_mtime.tv_nsec = srecord->sr_mtimeNsec;
+        inode->i_dinode.di_ctime.tv_sec = srecord->sr_ctime;
+        inode->i_dinode.di_ctime.tv_nsec = srecord->sr_ctimeNsec;
+        lc_markInodeDirty(inode, 0);
+    }
+    lc_inodeUnlock(inode);
+    ss->ss_records++;
+}
+
+/* Populate a new image layer from a stream file written by lc_layerSend.
+ * Request is in the form "<layer> <fd>".  Layer is made immutable when
+ * unmounted as usual.
+ */
+void
+lc_layerReceive(fuse_req_t req, struct gfs *gfs, char *name) {
+    struct sheader sheader;
+    struct srecord srecord;
+    char *path, *target;
+    struct sstream ss;
+    struct fs *fs;
+
+    fs = lc_streamOpen(req, &ss, name, false);
+    if (ss.ss_err) {
+        goto out;
+    }
+    if (fs->fs_frozen || !fs->fs_readOnly) {
+        ss.ss_err = EROFS;
+        goto out;
+    }
+    lc_streamRead(&ss, &sheader, sizeof(struct sheader));
+    if (!ss.ss_err && ((sheader.sh_magic != LC_SEND_MAGIC) ||
+                       (sheader.sh_version != LC_SEND_VERSION))) {
+        ss.ss_err = EINVAL;
+    }
+    if (ss.ss_err) {
+        goto out;
+    }
+    lc_printf("Receiving layer %d\n", fs->fs_gindex);
+    path = lc_malloc(fs, PATH_MAX, LC_MEMTYPE_PATH);
+    target = lc_malloc(fs, PATH_MAX, LC_MEMTYPE_PATH);
+    while (!ss.ss_err) {
+        lc_streamRead(&ss, &srecord, sizeof(struct srecord));
+        if (ss.ss_err || (srecord.sr_type == LC_SEND_END)) {
+            break;
+        }
+        lc_receiveRecord(&ss, &srecord, path, target);
+    }
+    lc_free(fs, target, PATH_MAX, LC_MEMTYPE_PATH);
+    lc_free(fs, path, PATH_MAX, LC_MEMTYPE_PATH);
+
+out:
+    lc_streamClose(req, &ss, __func__);
+}
@@ -50,6 +50,20 @@ static const char *requests[] = {
     "CLEANUP",
 };
 
+/* Phases of mount tracked in the startup report */
+static const char *mphases[] = {
+    "TOTAL",
+    "SUPER",
+    "LAYERS",
+    "EXTENTS",
+    "INODES",
+    "EMAP",
+    "DIR",
+    "XATTR",
+    "CRC",
+    "CLEANUP",
+};
+
 /* Allocate a new stats structure */
 void
 lc_statsNew(struct fs *fs) {
@@ -171,6 +185,43 @@ out:
               fs->fs_icount, fs->fs_pcount);
     lc_syslog(LOG_INFO, "\t%ld reads %ld writes (%ld inodes written)\n",
            fs->fs_reads, fs->fs_writes, fs->fs_iwrite);
+    lc_syslog(LOG_INFO, "\t%ld bytes read %ld bytes written\n",
+              fs->fs_readBytes, fs->fs_writeBytes);
+    lc_syslog(LOG_INFO, "\t%ld read requests (%ld bytes) "
+              "%ld write requests (%ld bytes)\n",
+              fs->fs_freads, fs->fs_freadBytes,
+              fs->fs_fwrites, fs->fs_fwriteBytes);
+    if (fs->fs_qos) {
+        lc_syslog(LOG_INFO, "\tLimits %ld ops/sec %ld bytes/sec, "
+                  "throttled %ld times\n", fs->fs_qos->q_iops.tb_rate,
+                  fs->fs_qos->q_bw.tb_rate, fs->fs_qos->q_throttled);
+    }
+    if (fs->fs_blockLimit || fs->fs_inodeLimit) {
+        lc_syslog(LOG_INFO, "\tSpace limits %ld blocks %ld inodes, "
+                  "in use %ld blocks %ld inodes, denied %ld times\n",
+                  fs->fs_blockLimit, fs->fs_inodeLimit,
+                  fs->fs_blocks - fs->fs_freed,
+                  fs->fs_icount - fs->fs_ricount, fs->fs_quotaDenied);
+    }
+    if (fs->fs_metaRuns) {
+        lc_syslog(LOG_INFO, "\tMetadata %ld blocks written in %ld runs\n",
+                  fs->fs_metaBlocks, fs->fs_metaRuns);
+    }
+    if (fs->fs_dirtyTime) {
+        lc_syslog(LOG_INFO, "\tMetadata unsynced for %ld seconds\n",
+                  time(NULL) - fs->fs_dirtyTime);
+    }
+    if (fs->fs_manifest) {
+        lc_syslog(LOG_INFO, "\tManifest %d blocks, prefetched %d times\n",
+                  fs->fs_manifest->m_count, fs->fs_manifest->m_prefetched);
+    }
+    if (fs->fs_bcache && (fs->fs_rfs == fs)) {
+        lc_syslog(LOG_INFO, "\tBlock cache %ld pages (share %ld) "
+                  "hits %ld misses %ld purged %ld\n",
+                  fs->fs_bcache->lb_pcount, fs->fs_bcache->lb_target,
+                  fs->fs_bcache->lb_hits, fs->fs_bcache->lb_misses,
+                  fs->fs_bcache->lb_purged);
+    }
     lc_syslog(LOG_INFO, "\n\n");
 }
 
@@ -194,6 +245,7 @@ lc_displayStatsAll(struct gfs *gfs) {
         if (fs) {
             if (i == 0) {
                 lc_displayGlobalMemStats();
+                lc_displayMountStats(gfs);
             }
             lc_displayLayerStats(fs);
         }
@@ -227,6 +279,125 @@ lc_displayGlobalStats(struct gfs *gfs) {
                   "reused %ld purged %ld\n", gfs->gfs_phit, gfs->gfs_pmissed,
                   gfs->gfs_precycle, gfs->gfs_preused, gfs->gfs_purged);
     }
+    if (gfs->gfs_plocal || gfs->gfs_premote) {
+        lc_syslog(LOG_INFO, "pages hit on %d NUMA nodes, local %ld remote %ld\n",
+                  gfs->gfs_nodes, gfs->gfs_plocal, gfs->gfs_premote);
+    }
+    if (gfs->gfs_ppinned || gfs->gfs_pinDenied) {
+        lc_syslog(LOG_INFO, "pages pinned %ld (limit %ld) denied %ld\n",
+                  gfs->gfs_ppinned, gfs->gfs_pinLimit, gfs->gfs_pinDenied);
+    }
+    if (gfs->gfs_ioDeferred) {
+        lc_syslog(LOG_INFO, "%ld I/Os deferred for higher priority I/O\n",
+                  gfs->gfs_ioDeferred);
+    }
+    if (gfs->gfs_reclaimed) {
+        lc_syslog(LOG_INFO, "%ld entries removed in the background\n",
+                  gfs->gfs_reclaimed);
+    }
+    if (gfs->gfs_syncSkipped) {
+        lc_syslog(LOG_INFO, "%ld busy layers skipped by checkpoints\n",
+                  gfs->gfs_syncSkipped);
+    }
+    if (gfs->gfs_reclaimedBlocks) {
+        lc_syslog(LOG_INFO, "%ld blocks released in the background\n",
+                  gfs->gfs_reclaimedBlocks);
+    }
+    if (gfs->gfs_zpages) {
+        lc_syslog(LOG_INFO, "%ld pages compressed to %ld blocks, "
+                  "%ld clusters decompressed\n",
+                  gfs->gfs_zpages, gfs->gfs_zblocks, gfs->gfs_zreads);
+    }
+    if (gfs->gfs_pspliced) {
+        lc_syslog(LOG_INFO, "%ld pages spliced from device\n",
+                  gfs->gfs_pspliced);
+    }
+    if (gfs->gfs_nshared) {
+        lc_syslog(LOG_INFO, "%ld file names interned, reused %ld times\n",
+                  gfs->gfs_ncount, gfs->gfs_nshared);
+    }
+}
+
+/* Begin tracking a phase of mount */
+void
+lc_mountStatsBegin(struct gfs *gfs, struct timeval *start, uint64_t *reads) {
+    if (gfs->gfs_mstats->ms_active) {
+        gettimeofday(start, NULL);
+        *reads = gfs->gfs_reads;
+    }
+}
+
+/* Account time and reads issued in a phase of mount.  Mount is single
+ * threaded, so no locking needed.
+ */
+void
+lc_mountStatsAdd(struct gfs *gfs, enum lc_mountPhase phase,
+                 struct timeval *start, uint64_t reads) {
+    struct mstats *mstats = gfs->gfs_mstats;
+    struct timeval stop, total;
+
+    if (!mstats->ms_active) {
+        return;
+    }
+    gettimeofday(&stop, NULL);
+    timersub(&stop, start, &total);
+    timeradd(&mstats->ms_time[phase], &total, &mstats->ms_time[phase]);
+    mstats->ms_reads[phase] += gfs->gfs_reads - reads;
+    mstats->ms_count[phase]++;
+}
+
+/* Account time taken for loading a layer and remember the slowest one */
+void
+lc_mountLayerStats(struct gfs *gfs, struct fs *fs, struct timeval *start,
+                   uint64_t reads) {
+    struct mstats *mstats = gfs->gfs_mstats;
+    struct timeval stop, total;
+
+    if (!mstats->ms_active) {
+        return;
+    }
+    gettimeofday(&stop, NULL);
+    timersub(&stop, start, &total);
+    lc_printf("Layer %d root %ld loaded in %lds.%06ldu, %ld inodes "
+              "%ld reads\n", fs->fs_gindex, fs->fs_root,
+              total.tv_sec, total.tv_usec, fs->fs_icount,
+              gfs->gfs_reads - reads);
+    if (timercmp(&mstats->ms_slowTime, &total, <)) {
+        mstats->ms_slowTime = total;
+        mstats->ms_slowLayer = fs->fs_gindex;
+    }
+}
+
+/* Display time and I/O spent in each phase of mount */
+void
+lc_displayMountStats(struct gfs *gfs) {
+    struct mstats *mstats = gfs->gfs_mstats;
+    enum lc_mountPhase i;
+
+    if (mstats->ms_count[LC_MOUNT_TOTAL] == 0) {
+        return;
+    }
+    lc_syslog(LOG_INFO, "Mount completed in %lds.%06ldu with %ld reads\n",
+              mstats->ms_time[LC_MOUNT_TOTAL].tv_sec,
+              mstats->ms_time[LC_MOUNT_TOTAL].tv_usec,
+              mstats->ms_reads[LC_MOUNT_TOTAL]);
+
+    /* Inode phase includes time spent in emap, dir and xattr phases.  All
+     * phases include time spent in verifying checksums.
+     */
+    lc_syslog(LOG_INFO, "\tPhase:\t\tCount\t\tReads\t\tTime\n");
+    for (i = LC_MOUNT_SUPER; i < LC_MOUNT_PHASE_MAX; i++) {
+        if (mstats->ms_count[i]) {
+            lc_syslog(LOG_INFO, "%15s: %10ld\t%10ld\t%2lds.%06ldu\n",
+                      mphases[i], mstats->ms_count[i], mstats->ms_reads[i],
+                      mstats->ms_time[i].tv_sec, mstats->ms_time[i].tv_usec);
+        }
+    }
+    if (mstats->ms_slowLayer) {
+        lc_syslog(LOG_INFO, "\tSlowest layer %d loaded in %lds.%06ldu\n",
+                  mstats->ms_slowLayer, mstats->ms_slowTime.tv_sec,
+                  mstats->ms_slowTime.tv_usec);
+    }
 }
 
 /* Free resources associated with the stats of a file system */
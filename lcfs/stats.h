@@ -63,4 +63,41 @@ struct stats {
     struct timeval s_total[LC_REQUEST_MAX];
 };
 
+/* Phases of mount tracked for the startup report */
+enum lc_mountPhase {
+    LC_MOUNT_TOTAL = 0,
+    LC_MOUNT_SUPER = 1,
+    LC_MOUNT_LAYERS = 2,
+    LC_MOUNT_EXTENTS = 3,
+    LC_MOUNT_INODES = 4,
+    LC_MOUNT_EMAP = 5,
+    LC_MOUNT_DIR = 6,
+    LC_MOUNT_XATTR = 7,
+    LC_MOUNT_CRC = 8,
+    LC_MOUNT_CLEANUP = 9,
+    LC_MOUNT_PHASE_MAX = 10,
+};
+
+/* Structure tracking time and I/O spent while mounting the device */
+struct mstats {
+
+    /* Time spent in each phase */
+    struct timeval ms_time[LC_MOUNT_PHASE_MAX];
+
+    /* Number of reads issued in each phase */
+    uint64_t ms_reads[LC_MOUNT_PHASE_MAX];
+
+    /* Number of times each phase is entered */
+    uint64_t ms_count[LC_MOUNT_PHASE_MAX];
+
+    /* Time taken by the layer slowest to load */
+    struct timeval ms_slowTime;
+
+    /* Index of the layer slowest to load */
+    int ms_slowLayer;
+
+    /* Set while mount is in progress */
+    bool ms_active;
+};
+
 #endif
@@ -34,13 +34,73 @@ lc_superValid(struct super *super) {
            (super->sb_version == LC_VERSION);
 }
 
+/* Read the table of layer superblocks with a few large reads, instead of a
+ * dependent read for each layer while following links between layers.
+ */
+void
+lc_superReadTable(struct gfs *gfs, struct fs *fs) {
+    struct iovec iovec[LC_READ_INODE_CLUSTER_SIZE];
+    uint64_t block = gfs->gfs_super->sb_layerBlock;
+    uint64_t count = gfs->gfs_super->sb_layerCount;
+    uint64_t i, j, rcount;
+
+    assert(gfs->gfs_stable == NULL);
+    if ((block == 0) || (count == 0) ||
+        ((block + count) >= gfs->gfs_super->sb_tblocks)) {
+        return;
+    }
+    gfs->gfs_stable = lc_malloc(fs, count * sizeof(struct super *),
+                                LC_MEMTYPE_BLOCK);
+    for (i = 0; i < count; i += rcount) {
+        rcount = count - i;
+        if (rcount > LC_READ_INODE_CLUSTER_SIZE) {
+            rcount = LC_READ_INODE_CLUSTER_SIZE;
+        }
+        for (j = 0; j < rcount; j++) {
+            lc_mallocBlockAligned(fs, (void **)&gfs->gfs_stable[i + j],
+                                  LC_MEMTYPE_BLOCK);
+            iovec[j].iov_base = gfs->gfs_stable[i + j];
+            iovec[j].iov_len = LC_BLOCK_SIZE;
+        }
+        lc_readBlocks(gfs, fs, iovec, rcount, block + i);
+    }
+}
+
+/* Free any superblocks from the table not consumed by layers */
+void
+lc_superFreeTable(struct gfs *gfs, struct fs *fs) {
+    uint64_t i, count = gfs->gfs_super->sb_layerCount;
+
+    if (gfs->gfs_stable == NULL) {
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        if (gfs->gfs_stable[i]) {
+            lc_free(fs, gfs->gfs_stable[i], LC_BLOCK_SIZE, LC_MEMTYPE_BLOCK);
+        }
+    }
+    lc_free(fs, gfs->gfs_stable, count * sizeof(struct super *),
+            LC_MEMTYPE_BLOCK);
+    gfs->gfs_stable = NULL;
+}
+
 /* Read file system super block */
 void
 lc_superRead(struct gfs *gfs, struct fs *fs, uint64_t block) {
+    uint64_t tblock = gfs->gfs_stable ? gfs->gfs_super->sb_layerBlock : 0;
     struct super *super;
 
-    lc_mallocBlockAligned(fs, (void **)&super, LC_MEMTYPE_BLOCK);
-    lc_readBlock(gfs, fs, block, super);
+    /* Take the superblock from the table if that was read already */
+    if (tblock && (block >= tblock) &&
+        (block < (tblock + gfs->gfs_super->sb_layerCount)) &&
+        gfs->gfs_stable[block - tblock]) {
+        super = gfs->gfs_stable[block - tblock];
+        gfs->gfs_stable[block - tblock] = NULL;
+        lc_memMove(lc_getGlobalFs(gfs), fs, LC_BLOCK_SIZE, LC_MEMTYPE_BLOCK);
+    } else {
+        lc_mallocBlockAligned(fs, (void **)&super, LC_MEMTYPE_BLOCK);
+        lc_readBlock(gfs, fs, block, super);
+    }
 
     /* Verify checksum if a valid super block is found */
     if (lc_superValid(super)) {
@@ -97,10 +157,14 @@ lc_allocateSuperBlocks(struct gfs *gfs, struct fs *rfs) {
     }
     lc_markSuperDirty(rfs);
 
-    /* Allocate new superblocks for all layers */
+    /* Allocate new superblocks for all layers, as a contiguous table
+     * recorded in the global superblock.
+     */
     count = gfs->gfs_count - 1;
     block = count ?
             lc_blockAllocExact(rfs, count, true, false) : LC_INVALID_BLOCK;
+    rfs->fs_super->sb_layerBlock = count ? block : 0;
+    rfs->fs_super->sb_layerCount = count;
     for (i = 1; i <= gfs->gfs_scount; i++) {
         fs = gfs->gfs_fs[i];
         if (fs) {
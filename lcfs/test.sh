@@ -5,6 +5,7 @@ MNT2=/lcfs
 LCFS=$PWD/lcfs
 XATTR=$PWD/testxattr
 TESTDIFF=$PWD/testdiff
+TESTLAYER=$PWD/testlayer
 
 umount -f $MNT $MNT2 2>/dev/null
 sleep 10
@@ -157,7 +158,41 @@ docker commit ${CID} hello
 for layer in *
 do
     $TESTDIFF $layer
+    $LCFS send $MNT $layer /tmp/lcfs-stream
 done
+rm -f /tmp/lcfs-stream
+
+#Send a layer and receive it into a new layer, then compare those.
+$TESTLAYER $MNT create lcfs-send
+$TESTLAYER $MNT mount lcfs-send
+mkdir -p lcfs-send/dir/dir1
+cp /etc/passwd lcfs-send/dir
+ln lcfs-send/dir/passwd lcfs-send/dir/dir1/passwd
+ln -s dir/passwd lcfs-send/link
+mknod lcfs-send/fifo p
+dd if=/dev/urandom of=lcfs-send/file count=10 bs=4096 seek=20
+setfattr -n user.lcfs -v send lcfs-send/file
+
+#Limit the layer, rewrite a file in place, then grow past the limit.
+$LCFS quota $MNT lcfs-send 1 0
+dd if=/dev/zero of=lcfs-send/quota count=128 bs=4096
+dd if=/dev/zero of=lcfs-send/quota count=128 bs=4096 conv=notrunc
+! dd if=/dev/zero of=lcfs-send/quota count=512 bs=4096
+$LCFS stats $MNT lcfs-send
+rm -f lcfs-send/quota
+$LCFS quota $MNT lcfs-send 0 0
+$TESTLAYER $MNT umount lcfs-send
+$LCFS send $MNT lcfs-send /tmp/lcfs-stream
+$TESTLAYER $MNT create lcfs-receive
+$TESTLAYER $MNT mount lcfs-receive
+$LCFS receive $MNT lcfs-receive /tmp/lcfs-stream
+$TESTLAYER $MNT umount lcfs-receive
+diff -r --no-dereference lcfs-send lcfs-receive
+getfattr -n user.lcfs lcfs-receive/file
+ls -lRi lcfs-send lcfs-receive
+$TESTLAYER $MNT remove lcfs-receive
+$TESTLAYER $MNT remove lcfs-send
+rm -f /tmp/lcfs-stream
 cd -
 
 docker save -o $MNT/h.tar hello
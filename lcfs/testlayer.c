@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "lcfs.h"
+
+/* Create, remove, mount or unmount a layer, as the graph driver does */
+int
+main(int argc, char *argv[]) {
+    char dir[PATH_MAX], name[PATH_MAX];
+    int fd, err, cmd, len, plen = 0;
+
+    if ((argc < 4) || (argc > 5)) {
+        fprintf(stderr, "usage: %s <mnt> <create|remove|mount|umount> "
+                "<layer> [parent]\n", argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[2], "create") == 0) {
+        cmd = LAYER_CREATE;
+    } else if (strcmp(argv[2], "remove") == 0) {
+        cmd = LAYER_REMOVE;
+    } else if (strcmp(argv[2], "mount") == 0) {
+        cmd = LAYER_MOUNT;
+    } else if (strcmp(argv[2], "umount") == 0) {
+        cmd = LAYER_UMOUNT;
+    } else {
+        fprintf(stderr, "Unknown command %s\n", argv[2]);
+        return 1;
+    }
+
+    /* Parent name is passed ahead of the layer name */
+    if ((argc == 5) && (cmd == LAYER_CREATE)) {
+        plen = strlen(argv[4]);
+        len = snprintf(name, sizeof(name), "%s/%s", argv[4], argv[3]);
+    } else {
+        len = snprintf(name, sizeof(name), "%s", argv[3]);
+    }
+    snprintf(dir, sizeof(dir), "%s/lcfs", argv[1]);
+    fd = open(dir, O_DIRECTORY);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+    err = ioctl(fd, _IOC(_IOC_WRITE, plen, cmd, len), name);
+    if (err) {
+        perror("ioctl");
+    }
+    close(fd);
+    return err ? 1 : 0;
+}
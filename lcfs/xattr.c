@@ -211,6 +211,24 @@ out:
     lc_unlock(fs);
 }
 
+/* Add an extended attribute to an inode being populated internally */
+void
+lc_xattrSet(struct inode *inode, const char *name, int len,
+            const char *value, size_t size) {
+    struct fs *fs = inode->i_fs;
+
+    if (!fs->fs_xattrEnabled) {
+        fs->fs_gfs->gfs_xattr_enabled = true;
+        fs->fs_xattrEnabled = true;
+        lc_printf("Enabled extended attributes\n");
+    }
+    if (inode->i_xattrData == NULL) {
+        lc_xattrInit(fs, inode);
+    }
+    lc_xattrLink(inode, name, len, value, size);
+    lc_markInodeDirty(inode, LC_INODE_XATTRDIRTY);
+}
+
 /* List the specified attributes of the inode */
 void
 lc_xattrList(fuse_req_t req, ino_t ino, size_t size) {
@@ -410,7 +428,7 @@ lc_xattrFlushBlocks(struct gfs *gfs, struct fs *fs,
     uint64_t block, count = pcount;
     struct xblock *xblock;
 
-    block = lc_blockAllocExact(fs, pcount, true, true);
+    block = lc_metaAlloc(fs, pcount);
 
     /* Link all the blocks together */
     while (page) {
@@ -425,7 +443,7 @@ lc_xattrFlushBlocks(struct gfs *gfs, struct fs *fs,
         page = page->p_dnext;
     }
     assert(count == 0);
-    lc_addPageForWriteBack(gfs, fs, fpage, tpage, pcount);
+    lc_metaWriteBack(gfs, fs, fpage, tpage, pcount);
     return block;
 }
 